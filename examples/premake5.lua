@@ -7,6 +7,30 @@ function specify_warnings()
 	linkoptions "-IGNORE:4099" -- disable linker warning: "PDB was not found ...; linking object as if no debug info"
 end
 
+-- Benchmarks are console programs built from source/bench_*.cpp; each one is compiled only when its define is set.
+-- Run them in the Release configuration.
+function bench_project(name, define)
+	project(name)
+		kind "ConsoleApp"
+		language "C++"
+		targetdir "build"
+		specify_warnings()
+		
+		includedirs "../"
+		
+		defines(define)
+		files "source/**"
+		
+		filter "configurations:Debug"
+			symbols "On"
+
+		filter "configurations:Release"
+			optimize "On"
+			defines "NDEBUG"
+
+		filter {}
+end
+
 workspace "examples"
 	architecture "x64"
 	configurations { "Debug", "Release" }
@@ -45,3 +69,10 @@ project "example_dx12"
 
 	filter "configurations:Release"
 		optimize "On"
+
+bench_project("bench_map", "BENCH_MAP")
+bench_project("bench_hash", "BENCH_HASH")
+bench_project("bench_cmap", "BENCH_CMAP")
+bench_project("bench_concurrent_arena", "BENCH_CONCURRENT_ARENA")
+bench_project("bench_pool", "BENCH_POOL")
+bench_project("bench_slab", "BENCH_SLAB")
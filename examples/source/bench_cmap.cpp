@@ -0,0 +1,89 @@
+#ifdef BENCH_CMAP
+
+// Measures DS_CMapFind throughput on 1 to N threads, against a DS_Map behind a std::mutex. Every lookup announces
+// itself in a striped reader counter (see DS_CMapReadBegin), so this shows how well those counters stay off each
+// other's cache lines as threads are added.
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fire_ds.h"
+
+#define KEY_COUNT (256 * 1024)
+#define LOOKUPS_PER_THREAD (4 * 1000 * 1000)
+
+static DS_BasicMemConfig g_mem;
+static DS_ConcurrentMap(uint64_t, uint64_t) g_cmap; // big, so it's not on the stack
+static DS_Map(uint64_t, uint64_t) g_locked_map;
+static std::mutex g_locked_map_mutex;
+
+static uint64_t NextRandom(uint64_t* state) {
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 16;
+}
+
+static void CMapReader(int thread_index, uint64_t* out_checksum) {
+	uint64_t rng = thread_index + 1, checksum = 0;
+	for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+		uint64_t key = NextRandom(&rng) % KEY_COUNT, value = 0;
+		DS_CMapFind(&g_cmap, key, &value);
+		checksum += value;
+	}
+	*out_checksum = checksum;
+}
+
+static void LockedMapReader(int thread_index, uint64_t* out_checksum) {
+	uint64_t rng = thread_index + 1, checksum = 0;
+	for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+		uint64_t key = NextRandom(&rng) % KEY_COUNT, value = 0;
+		g_locked_map_mutex.lock();
+		DS_MapFind(&g_locked_map, key, &value);
+		g_locked_map_mutex.unlock();
+		checksum += value;
+	}
+	*out_checksum = checksum;
+}
+
+// Returns the total number of lookups per second over all threads
+static double RunReaders(void (*reader)(int, uint64_t*), int thread_count) {
+	std::vector<std::thread> threads;
+	std::vector<uint64_t> checksums(thread_count);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < thread_count; i++) threads.emplace_back(reader, i, &checksums[i]);
+	for (int i = 0; i < thread_count; i++) threads[i].join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return (double)thread_count * LOOKUPS_PER_THREAD / seconds;
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+	DS_CMapInit(&g_cmap, g_mem.heap);
+	DS_MapInit(&g_locked_map, g_mem.heap);
+	for (uint64_t i = 0; i < KEY_COUNT; i++) {
+		uint64_t value = i * 3;
+		DS_CMapInsert(&g_cmap, i, value);
+		DS_MapInsert(&g_locked_map, i, value);
+	}
+
+	int max_threads = (int)std::thread::hardware_concurrency();
+	if (max_threads < 8) max_threads = 8;
+
+	printf("Lookups of %d keys, %d per thread, in millions of lookups per second:\n", KEY_COUNT, LOOKUPS_PER_THREAD);
+	printf("threads | DS_ConcurrentMap (per thread) | DS_Map + std::mutex (per thread)\n");
+	for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+		double cmap = RunReaders(CMapReader, thread_count) / 1e6;
+		double locked = RunReaders(LockedMapReader, thread_count) / 1e6;
+		printf("%7d | %8.1f (%6.1f)               | %8.1f (%6.1f)\n", thread_count,
+			cmap, cmap / thread_count, locked, locked / thread_count);
+	}
+
+	DS_MapDeinit(&g_locked_map);
+	DS_CMapDeinit(&g_cmap);
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_CMAP
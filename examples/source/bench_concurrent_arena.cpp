@@ -0,0 +1,81 @@
+#ifdef BENCH_CONCURRENT_ARENA
+
+// Measures DS_ConcurrentArenaPush throughput on 1 to N threads pushing into one shared arena, against the same pushes
+// into a regular DS_Arena behind a std::mutex. Each thread touches the memory it gets, like a real producer would.
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fire_ds.h"
+
+#define PUSHES_PER_THREAD (2 * 1000 * 1000)
+#define BLOCK_SIZE DS_MIB(1)
+
+static DS_BasicMemConfig g_mem;
+static DS_ConcurrentArena g_concurrent_arena;
+static DS_Arena g_locked_arena;
+static std::mutex g_locked_arena_mutex;
+
+static size_t PushSize(uint32_t* rng) {
+	*rng = *rng * 1664525 + 1013904223;
+	return 8 + (*rng >> 24) % 120; // 8 to 127 bytes
+}
+
+static void ConcurrentPusher(int thread_index) {
+	uint32_t rng = thread_index + 1;
+	for (int i = 0; i < PUSHES_PER_THREAD; i++) {
+		char* data = DS_ConcurrentArenaPush(&g_concurrent_arena, PushSize(&rng));
+		data[0] = (char)i;
+	}
+}
+
+static void LockedPusher(int thread_index) {
+	uint32_t rng = thread_index + 1;
+	for (int i = 0; i < PUSHES_PER_THREAD; i++) {
+		size_t size = PushSize(&rng);
+		g_locked_arena_mutex.lock();
+		char* data = DS_ArenaPush(&g_locked_arena, size);
+		g_locked_arena_mutex.unlock();
+		data[0] = (char)i;
+	}
+}
+
+// Returns the total number of pushes per second over all threads
+static double RunPushers(void (*pusher)(int), int thread_count) {
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < thread_count; i++) threads.emplace_back(pusher, i);
+	for (int i = 0; i < thread_count; i++) threads[i].join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return (double)thread_count * PUSHES_PER_THREAD / seconds;
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+
+	int max_threads = (int)std::thread::hardware_concurrency();
+	if (max_threads < 8) max_threads = 8;
+
+	printf("%d pushes of 8 to 127 bytes per thread into one arena, in millions of pushes per second:\n", PUSHES_PER_THREAD);
+	printf("threads | DS_ConcurrentArena (per thread) | DS_Arena + std::mutex (per thread)\n");
+	for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+		DS_ConcurrentArenaInit(&g_concurrent_arena, BLOCK_SIZE, g_mem.heap);
+		double concurrent = RunPushers(ConcurrentPusher, thread_count) / 1e6;
+		DS_ConcurrentArenaDeinit(&g_concurrent_arena);
+
+		DS_ArenaInit(&g_locked_arena, BLOCK_SIZE, g_mem.heap);
+		double locked = RunPushers(LockedPusher, thread_count) / 1e6;
+		DS_ArenaDeinit(&g_locked_arena);
+
+		printf("%7d | %8.1f (%6.1f)                 | %8.1f (%6.1f)\n", thread_count,
+			concurrent, concurrent / thread_count, locked, locked / thread_count);
+	}
+
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_CONCURRENT_ARENA
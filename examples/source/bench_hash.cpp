@@ -0,0 +1,97 @@
+#ifdef BENCH_HASH
+
+// Compares DS_FastHash64 against DS_MurmurHash3 for key sizes from 4 bytes to 1 KB, both on their own and as the
+// hash function of a DS_Map doing inserts and lookups.
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "fire_ds.h"
+
+static DS_BasicMemConfig g_mem;
+
+template<int N> struct Key { uint8_t bytes[N]; };
+
+static uint32_t HashMurmur3(const void* key, int size) { return DS_MurmurHash3(key, size, 989898); }
+static uint32_t HashFast64(const void* key, int size) { return (uint32_t)DS_FastHash64(key, size, 989898); }
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<int N> static std::vector<Key<N>> MakeKeys(int count) {
+	std::vector<Key<N>> keys(count);
+	uint64_t rng = 12345;
+	for (int i = 0; i < count; i++) {
+		for (int j = 0; j < N; j++) {
+			rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+			keys[i].bytes[j] = (uint8_t)(rng >> 56);
+		}
+	}
+	return keys;
+}
+
+// Returns nanoseconds per hashed key
+template<int N> static double BenchHashFn(DS_MapHashFn hash_fn, const std::vector<Key<N>>& keys, uint32_t* checksum) {
+	int rounds = (64 << 20) / (N * (int)keys.size()) + 1;
+	auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < rounds; round++) {
+		for (size_t i = 0; i < keys.size(); i++) *checksum += hash_fn(&keys[i], N);
+	}
+	return Seconds(start) / ((double)rounds * keys.size()) * 1e9;
+}
+
+// Returns nanoseconds per operation, with one insert for every four lookups
+template<int N> static double BenchMapWithHashFn(DS_MapHashFn hash_fn, const std::vector<Key<N>>& keys, uint32_t* checksum) {
+	DS_Map(Key<N>, int) map;
+	DS_MapInit(&map, g_mem.heap);
+	DS_MapSetHashFn(&map, hash_fn);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < (int)keys.size(); i++) DS_MapInsert(&map, keys[i], i);
+	for (int round = 0; round < 4; round++) {
+		for (size_t i = 0; i < keys.size(); i++) {
+			int value = 0;
+			DS_MapFind(&map, keys[i], &value);
+			*checksum += value;
+		}
+	}
+	double result = Seconds(start) / (5.0 * keys.size()) * 1e9;
+
+	DS_MapDeinit(&map);
+	return result;
+}
+
+template<int N> static void BenchKeySize() {
+	uint32_t checksum = 0;
+	std::vector<Key<N>> hash_keys = MakeKeys<N>(1024); // stays in cache, so this measures the hash alone
+	double murmur_hash = BenchHashFn<N>(HashMurmur3, hash_keys, &checksum);
+	double fast_hash = BenchHashFn<N>(HashFast64, hash_keys, &checksum);
+
+	std::vector<Key<N>> map_keys = MakeKeys<N>(N >= 256 ? 100000 : 500000);
+	double murmur_map = BenchMapWithHashFn<N>(HashMurmur3, map_keys, &checksum);
+	double fast_map = BenchMapWithHashFn<N>(HashFast64, map_keys, &checksum);
+
+	printf("%5d B | hash: murmur3 %7.1f ns, fast64 %7.1f ns (%5.1f GB/s) | map: murmur3 %6.1f ns, fast64 %6.1f ns  (checksum %u)\n",
+		N, murmur_hash, fast_hash, N / fast_hash, murmur_map, fast_map, checksum);
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+
+	printf("Time per hashed key, and per map operation (1 insert : 4 finds):\n");
+	BenchKeySize<4>();
+	BenchKeySize<8>();
+	BenchKeySize<16>();
+	BenchKeySize<32>();
+	BenchKeySize<64>();
+	BenchKeySize<128>();
+	BenchKeySize<256>();
+	BenchKeySize<1024>();
+
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_HASH
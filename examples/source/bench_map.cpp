@@ -0,0 +1,83 @@
+#ifdef BENCH_MAP
+
+// Compares the default DS_Map layout against DS_MapFlag_Groups on insert, successful and failed lookups and removal,
+// at map sizes that fit in L1, in L2/L3 and in main memory.
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "fire_ds.h"
+
+static DS_BasicMemConfig g_mem;
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t NextRandom(uint64_t* state) {
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state ^ (*state >> 29);
+}
+
+static void BenchMap(const char* name, DS_MapFlags flags, int count) {
+	std::vector<uint64_t> keys(count), missing_keys(count);
+	uint64_t rng = 12345;
+	for (int i = 0; i < count; i++) {
+		keys[i] = NextRandom(&rng) | 1;
+		missing_keys[i] = NextRandom(&rng) & ~1ull; // odd keys are present, even keys are not
+	}
+
+	// Repeat small maps so that every measurement covers enough operations to be stable
+	int rounds = 4000000 / count;
+	if (rounds < 1) rounds = 1;
+	double insert_time = 0, find_time = 0, miss_time = 0, remove_time = 0;
+	uint64_t checksum = 0;
+
+	for (int round = 0; round < rounds; round++) {
+		DS_Map(uint64_t, uint64_t) map;
+		DS_MapInitEx(&map, g_mem.heap, flags);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) DS_MapInsert(&map, keys[i], keys[i]);
+		insert_time += Seconds(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) {
+			uint64_t value = 0;
+			DS_MapFind(&map, keys[i], &value);
+			checksum += value;
+		}
+		find_time += Seconds(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) checksum += DS_MapFind(&map, missing_keys[i], (uint64_t*)NULL);
+		miss_time += Seconds(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) checksum += DS_MapRemove(&map, keys[i]);
+		remove_time += Seconds(start);
+
+		DS_MapDeinit(&map);
+	}
+
+	double ops = (double)count * rounds;
+	printf("%-8s %9d | insert %6.1f ns | find %6.1f ns | miss %6.1f ns | remove %6.1f ns  (checksum %llu)\n", name, count,
+		insert_time / ops * 1e9, find_time / ops * 1e9, miss_time / ops * 1e9, remove_time / ops * 1e9, (unsigned long long)checksum);
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+
+	printf("DS_Map(uint64_t, uint64_t), time per operation:\n");
+	int counts[] = {1000, 64 * 1000, 1000 * 1000, 8 * 1000 * 1000};
+	for (int i = 0; i < (int)DS_ArrayCount(counts); i++) {
+		BenchMap("default", 0, counts[i]);
+		BenchMap("groups", DS_MapFlag_Groups, counts[i]);
+	}
+
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_MAP
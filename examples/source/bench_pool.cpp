@@ -0,0 +1,78 @@
+#ifdef BENCH_POOL
+
+// Churn benchmark for DS_Pool against malloc / free: keep a fixed number of nodes alive and repeatedly free a random one
+// and allocate a replacement, like a long-running scene graph or free-list based cache would.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "fire_ds.h"
+
+#define LIVE_NODES (100 * 1000)
+#define CHURN_PAIRS (20 * 1000 * 1000)
+
+typedef struct Node {
+	struct Node* next;
+	uint64_t payload[6];
+} Node; // 56 bytes
+
+static DS_BasicMemConfig g_mem;
+
+static uint32_t NextRandom(uint32_t* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+template<typename AllocFn, typename FreeFn> static double RunChurn(AllocFn alloc_node, FreeFn free_node, uint64_t* checksum) {
+	std::vector<Node*> live(LIVE_NODES);
+	for (int i = 0; i < LIVE_NODES; i++) {
+		live[i] = alloc_node();
+		live[i]->payload[0] = i;
+	}
+
+	uint32_t rng = 12345;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < CHURN_PAIRS; i++) {
+		uint32_t slot = NextRandom(&rng) % LIVE_NODES;
+		*checksum += live[slot]->payload[0];
+		free_node(live[slot]);
+		live[slot] = alloc_node();
+		live[slot]->payload[0] = i;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	for (int i = 0; i < LIVE_NODES; i++) free_node(live[i]);
+	return ms;
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+	uint64_t checksum = 0;
+
+	double malloc_ms = RunChurn(
+		[]() { return (Node*)malloc(sizeof(Node)); },
+		[](Node* node) { free(node); },
+		&checksum);
+
+	DS_Pool pool;
+	DS_PoolInit(&pool, sizeof(Node), alignof(Node), g_mem.heap);
+	double pool_ms = RunChurn(
+		[&]() { return (Node*)DS_PoolAlloc(&pool); },
+		[&](Node* node) { DS_PoolFree(&pool, node); },
+		&checksum);
+	DS_PoolDeinit(&pool);
+
+	printf("%d live %d-byte nodes, %d random free + alloc pairs:\n", LIVE_NODES, (int)sizeof(Node), CHURN_PAIRS);
+	printf("  malloc / free: %7.1f ms (%5.1f ns per pair)\n", malloc_ms, malloc_ms * 1e6 / CHURN_PAIRS);
+	printf("  DS_Pool:       %7.1f ms (%5.1f ns per pair)\n", pool_ms, pool_ms * 1e6 / CHURN_PAIRS);
+	printf("  (checksum %llu)\n", (unsigned long long)checksum);
+
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_POOL
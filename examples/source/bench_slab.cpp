@@ -0,0 +1,74 @@
+#ifdef BENCH_SLAB
+
+// Multi-threaded allocation benchmark for DS_SlabAllocator against the heap allocator of DS_BasicMemConfig. Each thread
+// grows short-lived dynamic arrays, like a string builder would, and churns a set of longer-lived small blocks.
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "fire_ds.h"
+
+#define ITERATIONS_PER_THREAD (200 * 1000)
+#define LIVE_BLOCKS 256
+
+static DS_BasicMemConfig g_mem;
+
+static void Work(DS_Allocator* allocator, uint32_t seed) {
+	uint32_t rng = seed;
+	void* live[LIVE_BLOCKS] = {};
+	for (int i = 0; i < ITERATIONS_PER_THREAD; i++) {
+		rng = rng * 1664525 + 1013904223;
+
+		DS_DynArray(char) array;
+		DS_ArrInit(&array, allocator);
+		int count = 8 + (rng >> 20) % 200;
+		for (int j = 0; j < count; j++) DS_ArrPush(&array, (char)j);
+		DS_ArrDeinit(&array);
+
+		int slot = (rng >> 4) % LIVE_BLOCKS;
+		if (live[slot]) DS_MemFree(allocator, live[slot]);
+		live[slot] = DS_MemAlloc(allocator, 16 + (rng >> 12) % 512);
+	}
+	for (int i = 0; i < LIVE_BLOCKS; i++) {
+		if (live[i]) DS_MemFree(allocator, live[i]);
+	}
+}
+
+// `slab` may be NULL. Returns the wall clock time in milliseconds.
+static double Run(DS_Allocator* allocator, DS_SlabAllocator* slab, int thread_count) {
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < thread_count; i++) {
+		threads.emplace_back([=] {
+			Work(allocator, i + 1);
+			if (slab) DS_SlabAllocatorThreadFlush(slab);
+		});
+	}
+	for (int i = 0; i < thread_count; i++) threads[i].join();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+	DS_InitBasicMemConfig(&g_mem);
+
+	int max_threads = (int)std::thread::hardware_concurrency();
+	if (max_threads < 8) max_threads = 8;
+
+	printf("%d iterations per thread (one DS_DynArray of 8-207 chars, one block of 16-527 bytes replaced):\n", ITERATIONS_PER_THREAD);
+	for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+		DS_SlabAllocator slab;
+		DS_SlabAllocatorInit(&slab, g_mem.heap);
+		double slab_ms = Run((DS_Allocator*)&slab, &slab, thread_count);
+		DS_SlabAllocatorDeinit(&slab);
+
+		double heap_ms = Run(g_mem.heap, NULL, thread_count);
+		printf("  %2d threads: DS_SlabAllocator %7.1f ms, heap %7.1f ms\n", thread_count, slab_ms, heap_ms);
+	}
+
+	DS_DeinitBasicMemConfig(&g_mem);
+	return 0;
+}
+
+#endif // BENCH_SLAB
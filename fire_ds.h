@@ -24,6 +24,23 @@
 #include <stdlib.h>
 #endif
 
+// Define DS_NO_VIRTUAL_MEMORY to leave out the virtual memory arena backend and the OS headers it needs.
+// On Windows, the few functions it needs are declared in the implementation section instead of including Windows.h.
+#if !defined(DS_NO_VIRTUAL_MEMORY) && !defined(_WIN32)
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_ANONYMOUS // e.g. strict ISO C mode without _DEFAULT_SOURCE; there's no portable way to reserve address space then.
+#define DS_NO_VIRTUAL_MEMORY
+#endif
+#endif
+
+#if defined(DS_ARENA_STATS) || defined(DS_ALLOCATOR_TRACKING)
+#include <stdio.h>
+#include <stdarg.h>
+#endif
+
 #ifndef DS_PROFILER_MACROS_OVERRIDE
 #define DS_ProfEnter()  // Function-level profiler scope. A single function may only have one of these, and it should span the entire function.
 #define DS_ProfExit()
@@ -47,6 +64,26 @@
 #define DS_MAX_ELEM_SIZE 2048
 #endif
 
+// Define DS_NO_SIMD to use the portable fallbacks instead of SSE2 / NEON intrinsics.
+#ifndef DS_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DS_MAP_SSE2
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define DS_MAP_NEON
+#endif
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DS_Prefetch(PTR) _mm_prefetch((const char*)(PTR), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define DS_Prefetch(PTR) __builtin_prefetch(PTR)
+#else
+#define DS_Prefetch(PTR) (void)0
+#endif
+
 #ifdef __cplusplus
 #define DS_LangAgnosticLiteral(T) T   // in C++, struct and union literals are of the form MyStructType{...}
 #else
@@ -100,6 +137,46 @@ typedef struct DS_ArenaMark {
 	char* ptr;
 } DS_ArenaMark;
 
+#ifdef DS_ARENA_STATS
+#ifndef DS_ARENA_STATS_MAX_SITES
+#define DS_ARENA_STATS_MAX_SITES 128
+#endif
+
+typedef struct DS_ArenaStatsSite {
+	const char* file; // NULL for pushes that don't come through the DS_ArenaPush* macros, e.g. allocator procs
+	int line;
+	uint64_t push_count;
+	uint64_t bytes;
+} DS_ArenaStatsSite;
+
+typedef struct DS_ArenaStats {
+	uint64_t push_count;
+	uint64_t bytes_pushed;
+	uint64_t alignment_padding; // bytes skipped to align pushes
+	uint64_t block_tail_waste;  // bytes left unused at the end of a block when a push didn't fit and moved on to the next block
+	uint64_t blocks_allocated;
+	uint64_t blocks_reused;     // times a block kept from before a DS_ArenaSetMark / DS_ArenaReset was moved into
+	size_t bytes_used;          // bytes between the start of the arena and the mark, including block headers and waste
+	size_t peak_bytes_used;     // highest bytes_used since the last DS_ArenaReset
+	size_t peak_bytes_used_before_reset; // highest bytes_used between the last two DS_ArenaResets
+	size_t peak_bytes_used_ever;
+	int sites_count;
+	uint64_t sites_dropped; // pushes from call sites that didn't fit in `sites`
+	DS_ArenaStatsSite sites[DS_ARENA_STATS_MAX_SITES];
+} DS_ArenaStats;
+#endif
+
+typedef int DS_ArenaFlags;
+typedef enum DS_ArenaFlagBits {
+	// Back the arena with huge pages to reduce TLB misses. On Linux, this uses transparent huge pages (MADV_HUGEPAGE)
+	// and commits memory in DS_ARENA_HUGE_PAGE_SIZE granules. On Windows, this uses MEM_LARGE_PAGES, which requires the
+	// SeLockMemoryPrivilege and commits the whole reservation up front.
+	DS_ArenaFlag_HugePages = 1 << 0,
+
+	// Fault in newly committed pages immediately instead of on first touch.
+	DS_ArenaFlag_Prefault = 1 << 1,
+} DS_ArenaFlagBits;
+
 typedef struct DS_Arena {
 	union {
 		DS_AllocatorBase base;
@@ -109,7 +186,24 @@ typedef struct DS_Arena {
 	DS_ArenaMark mark;
 	DS_Allocator* allocator;
 	size_t block_size;
+	size_t next_block_size; // Size of the next new block, see DS_ArenaSetMaxBlockSize
+	size_t max_block_size;
 	size_t total_mem_reserved;
+	char* committed_end; // Only used by virtual memory arenas (see DS_ArenaInitVirtual), NULL otherwise.
+	size_t commit_size;  // Only used by virtual memory arenas
+	char* dirty_end;     // Only used by virtual memory arenas. Highest mark the arena has been rewound from; committed memory above both this and the mark is known to be zero.
+	DS_ArenaFlags flags; // Only used by virtual memory arenas. These are the flags that were actually honored.
+
+	// Retention policy for DS_ArenaReset, see DS_ArenaSetRetention
+	size_t retain_size;
+	int retain_resets;
+	int resets_in_window;
+	size_t high_water_curr_window;
+	size_t high_water_prev_window;
+
+#ifdef DS_ARENA_STATS
+	DS_ArenaStats stats;
+#endif
 } DS_Arena;
 
 // --- Internal helpers -------------------------------------
@@ -126,6 +220,7 @@ typedef struct DS_Arena {
 #endif
 
 #ifndef DS_NO_MALLOC
+#ifdef _WIN32
 static void* DS_HeapAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
 	if (size == 0) {
 		_aligned_free(ptr);
@@ -134,6 +229,10 @@ static void* DS_HeapAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t
 		return _aligned_realloc(ptr, size, align);
 	}
 }
+#else
+// Implemented with malloc and mmap, see DS_HeapHeader.
+static void* DS_HeapAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align);
+#endif
 
 struct DS_BasicMemConfig {
 	DS_Info ds_info;
@@ -190,12 +289,82 @@ static inline void DS_ArrBoundsCheck_(bool x) { DS_ASSERT(x); }
 
 #define DS_Clone(T, ARENA, ...) DS_Clone_(T, ARENA, __VA_ARGS__)
 
-#define DS_New(T, ARENA) (T*)DS_Clone(T, (ARENA), DS_LangAgnosticZero(T))
+#define DS_New(T, ARENA) (T*)DS_ArenaPushZero((ARENA), sizeof(T))
 
 #ifndef DS_DebugFillGarbage
 #define DS_DebugFillGarbage(ptr, size) memset(ptr, 0xCC, size)
 #endif
 
+// -- Atomics ----------------------------------------------
+//
+// Minimal atomic operations used by the thread-safe data structures in this file.
+// Loads are acquire, stores are release and read-modify-write operations are sequentially consistent.
+
+#if defined(_MSC_VER)
+#define DS_THREAD_LOCAL __declspec(thread)
+#elif defined(__cplusplus)
+#define DS_THREAD_LOCAL thread_local
+#else
+#define DS_THREAD_LOCAL _Thread_local
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#if defined(_M_ARM64)
+#define DS_AtomicFence() __dmb(_ARM64_BARRIER_ISH)
+#define DS_AtomicAcquireBarrier_() __dmb(_ARM64_BARRIER_ISH)
+#define DS_SpinPause() __yield()
+#else
+#define DS_AtomicFence() (_ReadWriteBarrier(), _mm_mfence())
+#define DS_AtomicAcquireBarrier_() _ReadWriteBarrier() // x86 loads already have acquire semantics
+#define DS_SpinPause() _mm_pause()
+#endif
+static inline uint32_t DS_AtomicLoad32(volatile uint32_t* p) { uint32_t x = *p; DS_AtomicAcquireBarrier_(); return x; }
+static inline uint64_t DS_AtomicLoad64(volatile uint64_t* p) { uint64_t x = (uint64_t)__iso_volatile_load64((volatile __int64*)p); DS_AtomicAcquireBarrier_(); return x; }
+static inline void* DS_AtomicLoadPtr(void* volatile* p) { void* x = *p; DS_AtomicAcquireBarrier_(); return x; }
+static inline void DS_AtomicStore32(volatile uint32_t* p, uint32_t x) { _InterlockedExchange((volatile long*)p, (long)x); }
+static inline void DS_AtomicStorePtr(void* volatile* p, void* x) { _InterlockedExchangePointer(p, x); }
+static inline uint32_t DS_AtomicExchange32(volatile uint32_t* p, uint32_t x) { return (uint32_t)_InterlockedExchange((volatile long*)p, (long)x); }
+static inline uint32_t DS_AtomicAdd32(volatile uint32_t* p, uint32_t x) { return (uint32_t)_InterlockedExchangeAdd((volatile long*)p, (long)x); }
+static inline uint64_t DS_AtomicAdd64(volatile uint64_t* p, uint64_t x) { return (uint64_t)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)x); }
+static inline bool DS_AtomicCompareExchange64(volatile uint64_t* p, uint64_t expected, uint64_t desired) { return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)desired, (__int64)expected) == expected; }
+static inline bool DS_AtomicCompareExchangePtr(void* volatile* p, void* expected, void* desired) { return _InterlockedCompareExchangePointer(p, desired, expected) == expected; }
+#else
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DS_SpinPause() _mm_pause()
+#elif defined(__aarch64__)
+#define DS_SpinPause() __asm__ __volatile__("yield")
+#else
+#define DS_SpinPause() (void)0
+#endif
+#define DS_AtomicFence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+static inline uint32_t DS_AtomicLoad32(volatile uint32_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline uint64_t DS_AtomicLoad64(volatile uint64_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void* DS_AtomicLoadPtr(void* volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void DS_AtomicStore32(volatile uint32_t* p, uint32_t x) { __atomic_store_n(p, x, __ATOMIC_RELEASE); }
+static inline void DS_AtomicStorePtr(void* volatile* p, void* x) { __atomic_store_n(p, x, __ATOMIC_RELEASE); }
+static inline uint32_t DS_AtomicExchange32(volatile uint32_t* p, uint32_t x) { return __atomic_exchange_n(p, x, __ATOMIC_SEQ_CST); }
+static inline uint32_t DS_AtomicAdd32(volatile uint32_t* p, uint32_t x) { return __atomic_fetch_add(p, x, __ATOMIC_SEQ_CST); }
+static inline uint64_t DS_AtomicAdd64(volatile uint64_t* p, uint64_t x) { return __atomic_fetch_add(p, x, __ATOMIC_SEQ_CST); }
+static inline bool DS_AtomicCompareExchange64(volatile uint64_t* p, uint64_t expected, uint64_t desired) { return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+static inline bool DS_AtomicCompareExchangePtr(void* volatile* p, void* expected, void* desired) { return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+#endif
+
+typedef struct DS_SpinLock {
+	volatile uint32_t locked;
+} DS_SpinLock;
+
+static inline void DS_SpinLockEnter(DS_SpinLock* lock) {
+	while (DS_AtomicExchange32(&lock->locked, 1)) {
+		while (DS_AtomicLoad32(&lock->locked)) DS_SpinPause();
+	}
+}
+
+static inline void DS_SpinLockExit(DS_SpinLock* lock) {
+	DS_AtomicStore32(&lock->locked, 0);
+}
+
 // -- Map & Set ---------------------------------------------
 //
 // Generic hash map & hash set implementation.
@@ -239,20 +408,101 @@ static inline void DS_ArrBoundsCheck_(bool x) { DS_ASSERT(x); }
 //   
 //   DS_MapDeinit(&map); // Reset the map and free the memory if using the heap allocator
 // 
+// Instead of DS_MapInit, you can use DS_MapInitEx(&map, allocator, DS_MapFlag_Groups) to opt a map into the
+// Swiss-table style layout. All of the macros above work the same way with either layout.
+//
 
 // Basic hash functions
 DS_API uint32_t DS_MurmurHash3(const void* key, size_t size, uint32_t seed);
 DS_API uint64_t DS_MurmurHash64A(const void* key, size_t size, uint64_t seed);
 
+// High-throughput 64-bit hash. Short keys are hashed without loops and long keys use SSE2 when available.
+DS_API uint64_t DS_FastHash64(const void* key, size_t size, uint64_t seed);
+
+// The hash function that DS_MapHashDefault uses. You can define this to DS_MAP_HASH_MURMUR3 to get the old behaviour.
+#define DS_MAP_HASH_FAST 1
+#define DS_MAP_HASH_MURMUR3 2
+#ifndef DS_MAP_DEFAULT_HASH
+#define DS_MAP_DEFAULT_HASH DS_MAP_HASH_FAST
+#endif
+
+// A map hash function. If a map's `hash_fn` is NULL, DS_MapHashDefault is used.
+// The returned hash may be any value; it is remapped internally if it is 0.
+typedef uint32_t (*DS_MapHashFn)(const void* key, int size);
+
+// DS_FastHash64 (or DS_MurmurHash3, see DS_MAP_DEFAULT_HASH) with the seed used by DS_Map. With DS_FastHash64,
+// 4 and 8 byte keys are passed to DS_MapHashInt instead.
+DS_API uint32_t DS_MapHashDefault(const void* key, int size);
+
+// Cheap multiply-xorshift mixer for 4 and 8 byte keys, i.e. integers, pointers and keys which are already hashes.
+// Falls back to DS_MapHashDefault for other key sizes.
+DS_API uint32_t DS_MapHashInt(const void* key, int size);
+
 // If using a struct as the key type in a DS_Map, it must not contain any compiler-generated padding, as that could cause
 // unpredictable behaviour when memcmp is used on them.
 #define DS_NoteAboutKeyTypePadding
 
+typedef int DS_MapFlags;
+typedef enum DS_MapFlagBits {
+	// Swiss-table style layout. A separate array of 1-byte control bytes (7 bits of the hash, or empty/deleted) is stored
+	// after the elements, and probing scans it 16 slots at a time using SSE2/NEON compare masks. Elements are only touched
+	// on a fingerprint match, which makes lookups in big tables considerably more cache-friendly.
+	DS_MapFlag_Groups = 1 << 0,
+
+	// Instead of rehashing every element at once when the map grows, keep the old table alive and move a bounded number
+	// of its slots (DS_MAP_INCREMENTAL_GROW_STEP) into the new table on every insert and remove. Lookups check both tables
+	// while the migration is in progress. Only the rehashing is amortized, so an insert that grows the map is still
+	// O(capacity): it allocates and clears the new table, which with DS_MapFlag_Groups is just 1 byte per slot. It also
+	// finishes the previous migration on the spot if that one isn't done yet, which can't happen with the default step of 8,
+	// as a map needs at least 0.4 * capacity more inserts and removes before it grows again.
+	DS_MapFlag_IncrementalGrow = 1 << 1,
+
+	// Make DS_MapClear O(1). The top 8 bits of each stored hash are replaced with the generation of the map, and a slot is
+	// only considered live if its generation matches the current one, so clearing just bumps the generation. The whole
+	// table is only zeroed once every 255 clears. Not compatible with DS_MapFlag_Groups, where DS_MapClear already only
+	// has to reset one control byte per slot. The slot index comes from the remaining 24 hash bits, so the table may have
+	// at most 2^24 slots (about 11 million elements); beyond that, most slots would be unreachable and keys would pile
+	// up in long probe chains. This is asserted.
+	DS_MapFlag_FastClear = 1 << 2,
+
+	// Shrink the table in DS_MapClear if the map has used no more than a quarter of its capacity for
+	// DS_MAP_SHRINK_AFTER_CLEARS clears in a row. This way, a one-off spike doesn't pin a huge table forever, but a map
+	// whose size fluctuates a bit isn't reallocated all the time either.
+	DS_MapFlag_ShrinkOnClear = 1 << 3,
+} DS_MapFlagBits;
+
+// Flags that DS_MapInit / DS_SetInit use. You can define this to e.g. DS_MapFlag_Groups to opt every map into the group layout.
+#ifndef DS_MAP_DEFAULT_FLAGS
+#define DS_MAP_DEFAULT_FLAGS 0
+#endif
+
+#ifndef DS_MAP_INCREMENTAL_GROW_STEP
+#define DS_MAP_INCREMENTAL_GROW_STEP 8
+#endif
+
+#ifndef DS_MAP_SHRINK_AFTER_CLEARS
+#define DS_MAP_SHRINK_AFTER_CLEARS 8
+#endif
+
+// State of DS_MapFlag_IncrementalGrow and DS_MapFlag_ShrinkOnClear. It's allocated from the map's allocator the first
+// time it's needed, so that maps which don't use these modes don't pay for it in their size.
+typedef struct DS_MapModeState {
+	void* old_data; // Table that an incremental migration is moving elements out of, or NULL
+	int32_t old_capacity;
+	int32_t migrate_index;
+	int32_t small_clears;
+	int32_t small_clears_peak;
+} DS_MapModeState;
+
 #define DS_Map(K, V) \
-	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; V value; }* data; int32_t count; int32_t capacity; }
+	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; V value; }* data; int32_t count; int32_t capacity; DS_MapHashFn hash_fn; \
+	DS_MapModeState* modes; int32_t tombstones; uint8_t flags; uint8_t generation; }
 typedef DS_Map(char, char) DS_MapRaw;
 
-#define DS_MapInit(MAP, ALLOCATOR)            DS_MapInitRaw((DS_MapRaw*)(MAP), (ALLOCATOR))
+#define DS_MapInit(MAP, ALLOCATOR)            DS_MapInitRaw((DS_MapRaw*)(MAP), (ALLOCATOR), DS_MAP_DEFAULT_FLAGS)
+
+// * FLAGS is a combination of DS_MapFlagBits, e.g. DS_MapFlag_Groups | DS_MapFlag_IncrementalGrow.
+#define DS_MapInitEx(MAP, ALLOCATOR, FLAGS)   DS_MapInitRaw((DS_MapRaw*)(MAP), (ALLOCATOR), (FLAGS))
 
 #define DS_MapInitClone(MAP, SRC, ALLOCATOR)  DS_MapInitCloneRaw((DS_MapRaw*)(MAP), (DS_MapRaw*)(SRC), (ALLOCATOR), DS_MapElemSize(SRC))
 
@@ -287,9 +537,62 @@ typedef DS_Map(char, char) DS_MapRaw;
 	(DS_MapTypecheckK(MAP, &(KEY)) && DS_MapTypecheckV(MAP, *(OUT_VALUE)), \
 	DS_MapGetOrAddRaw((DS_MapRaw*)(MAP), &(KEY), (void**)OUT_VALUE, DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
 
+// * Looks up COUNT keys at once. OUT_VALUES[i] is set to the address of the value of KEYS[i], or NULL if it's not found.
+// * This is faster than calling DS_MapFindPtr in a loop for big maps, because all keys in a batch are hashed and their
+//   home slots prefetched up front, so the cache misses of the lookups overlap rather than happen one after another.
+#define DS_MapFindN(MAP, KEYS, COUNT, OUT_VALUES) /* (DS_Map(K, V)* MAP, const K* KEYS, int COUNT, V** OUT_VALUES) */ \
+	(DS_MapTypecheckK((MAP), (KEYS)) && DS_MapTypecheckV(MAP, *(OUT_VALUES)), \
+	DS_MapFindNRaw((DS_MapRaw*)(MAP), (KEYS), (COUNT), (void**)(OUT_VALUES), NULL, DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
+// * Same as DS_MapFindN, but sets OUT_FOUND[i] to whether KEYS[i] exists in the map.
+#define DS_MapContainsN(MAP, KEYS, COUNT, OUT_FOUND) /* (DS_Map(K, V)* MAP, const K* KEYS, int COUNT, bool* OUT_FOUND) */ \
+	(DS_MapTypecheckK((MAP), (KEYS)), \
+	DS_MapFindNRaw((DS_MapRaw*)(MAP), (KEYS), (COUNT), NULL, (OUT_FOUND), DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
 #define DS_MapClear(MAP) \
 	DS_MapClearRaw((DS_MapRaw*)(MAP), DS_MapElemSize(MAP))
 
+// * Grow the table up front so that it can hold COUNT keys in total without growing, e.g. before a bulk insert.
+#define DS_MapReserve(MAP, COUNT) \
+	DS_MapReserveRaw((DS_MapRaw*)(MAP), (COUNT), DS_MapElemSize(MAP))
+
+// * Shrink the table to the smallest capacity that fits the current keys, or free it if the map is empty.
+#define DS_MapShrinkToFit(MAP) \
+	DS_MapShrinkToFitRaw((DS_MapRaw*)(MAP), DS_MapElemSize(MAP))
+
+// * Set the hash function of an empty map, e.g. DS_MapSetHashFn(&map, DS_MapHashInt) for integer keys.
+#define DS_MapSetHashFn(MAP, HASH_FN) /* (DS_Map(K, V)* MAP, DS_MapHashFn HASH_FN) */ do { \
+	DS_ASSERT((MAP)->count == 0); \
+	(MAP)->hash_fn = (HASH_FN); } while (0)
+
+// * Returns the hash of KEY using the map's hash function.
+// * The hash can be passed to the ...WithHash macros of any map that uses the same key type and hash function,
+//   so that a key which is looked up from several maps only needs to be hashed once.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_MapHash(MAP, KEY) /* (DS_Map(K, V)* MAP, K KEY) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)), DS_MapHashRaw((DS_MapRaw*)(MAP), &(KEY), DS_MapKSize(MAP)))
+
+// Variants of the above macros which take a precomputed HASH from DS_MapHash.
+#define DS_MapFindWithHash(MAP, KEY, HASH, OUT_VALUE) /* (DS_Map(K, V)* MAP, K KEY, uint32_t HASH, (optional null) V* OUT_VALUE) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)) && DS_MapTypecheckV(MAP, OUT_VALUE), \
+	DS_MapFindRawEx((DS_MapRaw*)(MAP), &(KEY), OUT_VALUE, DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP), (HASH)))
+
+#define DS_MapFindPtrWithHash(MAP, KEY, HASH) /* (DS_Map(K, V)* MAP, K KEY, uint32_t HASH) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)), \
+	DS_MapFindPtrRawEx((DS_MapRaw*)(MAP), &(KEY), DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP), (HASH)))
+
+#define DS_MapInsertWithHash(MAP, KEY, HASH, VALUE) /* (DS_Map(K, V)* MAP, K KEY, uint32_t HASH, V VALUE) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)) && DS_MapTypecheckV(MAP, &(VALUE)), \
+	DS_MapInsertRawEx((DS_MapRaw*)(MAP), &(KEY), &(VALUE), DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP), (HASH)))
+
+#define DS_MapGetOrAddPtrWithHash(MAP, KEY, HASH, OUT_VALUE) /* (DS_Map(K, V)* MAP, K KEY, uint32_t HASH, V** OUT_VALUE) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)) && DS_MapTypecheckV(MAP, *(OUT_VALUE)), \
+	DS_MapGetOrAddRawEx((DS_MapRaw*)(MAP), &(KEY), (void**)OUT_VALUE, DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP), DS_MapFixHash(HASH)))
+
+#define DS_MapRemoveWithHash(MAP, KEY, HASH) /* (DS_Map(K, V)* MAP, K KEY, uint32_t HASH) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)), \
+	DS_MapRemoveRawEx((DS_MapRaw*)(MAP), &(KEY), DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP), (HASH)))
+
 // * Reset the map to a default state and free its memory if using the heap allocator.
 #define DS_MapDeinit(MAP) /* (DS_Map(K, V)* MAP) */ \
 	DS_MapDeinitRaw((DS_MapRaw*)(MAP), DS_MapElemSize(MAP))
@@ -327,10 +630,12 @@ typedef DS_Map(char, char) DS_MapRaw;
 //
 
 #define DS_Set(K) \
-	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; } *data; int32_t count; int32_t capacity; }
+	struct { DS_Allocator* allocator; struct{ uint32_t hash; K key; } *data; int32_t count; int32_t capacity; DS_MapHashFn hash_fn; \
+	DS_MapModeState* modes; int32_t tombstones; uint8_t flags; uint8_t generation; }
 typedef DS_Set(char) DS_SetRaw;
 
-#define DS_SetInit(SET, ALLOCATOR)        DS_MapInitRaw((DS_MapRaw*)(SET), (ALLOCATOR))
+#define DS_SetInit(SET, ALLOCATOR)        DS_MapInitRaw((DS_MapRaw*)(SET), (ALLOCATOR), DS_MAP_DEFAULT_FLAGS)
+#define DS_SetInitEx(SET, ALLOCATOR, FLAGS) DS_MapInitRaw((DS_MapRaw*)(SET), (ALLOCATOR), (FLAGS))
 
 // * Returns true if the key was found.
 // * KEY must be an l-value, otherwise this macro won't compile.
@@ -355,39 +660,118 @@ typedef DS_Set(char) DS_SetRaw;
 	if ((SET)->count > 0) for (struct DS_Concat(_dummy_, __LINE__) IT = {0}; \
 		DS_MapIter((DS_MapRaw*)(SET), &IT.i_next, (void**)&IT.elem, NULL, DS_MapKOffset(SET), 0, DS_MapElemSize(SET)); )
 
+// * Sets OUT_FOUND[i] to whether KEYS[i] exists in the set. See DS_MapFindN.
+#define DS_SetContainsN(SET, KEYS, COUNT, OUT_FOUND) /* (DS_Set(K) *SET, const K* KEYS, int COUNT, bool* OUT_FOUND) */ \
+	(DS_MapTypecheckK(SET, (KEYS)), \
+	DS_MapFindNRaw((DS_MapRaw*)(SET), (KEYS), (COUNT), NULL, (OUT_FOUND), DS_MapKSize(SET), 0, DS_MapElemSize(SET), DS_MapKOffset(SET), 0))
+
 #define DS_SetClear(SET) \
 	DS_MapClearRaw((DS_MapRaw*)(SET), DS_MapElemSize(SET))
 
+#define DS_SetReserve(SET, COUNT)  DS_MapReserveRaw((DS_MapRaw*)(SET), (COUNT), DS_MapElemSize(SET))
+#define DS_SetShrinkToFit(SET)     DS_MapShrinkToFitRaw((DS_MapRaw*)(SET), DS_MapElemSize(SET))
+
+#define DS_SetSetHashFn(SET, HASH_FN) DS_MapSetHashFn(SET, HASH_FN)
+#define DS_SetHash(SET, KEY) DS_MapHash(SET, KEY)
+
+#define DS_SetContainsWithHash(SET, KEY, HASH) /* (DS_Set(K) *SET, K KEY, uint32_t HASH) */ \
+	(DS_MapTypecheckK(SET, &(KEY)), \
+	DS_MapFindRawEx((DS_MapRaw*)SET, &(KEY), NULL, DS_MapKSize(SET), 0, DS_MapElemSize(SET), DS_MapKOffset(SET), 0, (HASH)))
+
+#define DS_SetAddWithHash(SET, KEY, HASH) /* (DS_Set(K) *SET, K KEY, uint32_t HASH) */ \
+	(DS_MapTypecheckK(SET, &(KEY)), \
+	DS_MapInsertRawEx((DS_MapRaw*)(SET), &(KEY), NULL, DS_MapKSize(SET), 0, DS_MapElemSize(SET), DS_MapKOffset(SET), 0, (HASH)))
+
+#define DS_SetRemoveWithHash(SET, KEY, HASH) /* (DS_Set(K) *SET, K KEY, uint32_t HASH) */ \
+	(DS_MapTypecheckK(SET, &(KEY)), \
+	DS_MapRemoveRawEx((DS_MapRaw*)(SET), &(KEY), DS_MapKSize(SET), 0, DS_MapElemSize(SET), DS_MapKOffset(SET), 0, (HASH)))
+
 // * Reset the set to a default state and free its memory if using the heap allocator.
 #define DS_SetDeinit(SET) /* (DS_Set(K) *SET) */ \
 	DS_MapDeinitRaw((DS_MapRaw*)(SET), DS_MapElemSize(SET))
 
+// Hash 0 is reserved for empty slots and DS_MAP_TOMBSTONE_HASH for deleted slots in the old table during an incremental migration.
+#define DS_MAP_TOMBSTONE_HASH 1
+static inline uint32_t DS_MapFixHash(uint32_t hash) { return hash <= DS_MAP_TOMBSTONE_HASH ? hash + 2 : hash; }
+
+static inline uint32_t DS_MapHashRaw(DS_MapRaw* map, const void* key, int K_size) {
+	uint32_t hash = map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size);
+	return DS_MapFixHash(hash);
+}
+
+// With DS_MapFlag_FastClear, the top 8 bits of a stored hash hold the generation it was inserted in. Since the
+// generation is never 0, a tagged hash is never 0 or DS_MAP_TOMBSTONE_HASH.
+static inline uint32_t DS_MapTagHash(const DS_MapRaw* map, uint32_t hash) {
+	return map->flags & DS_MapFlag_FastClear ? (hash & 0x00FFFFFF) | ((uint32_t)map->generation << 24) : hash;
+}
+
+static inline bool DS_MapHashIsLive(const DS_MapRaw* map, uint32_t elem_hash) {
+	if (map->flags & DS_MapFlag_FastClear) return (elem_hash >> 24) == map->generation;
+	return elem_hash > DS_MAP_TOMBSTONE_HASH;
+}
+
+// A probe sequence continues past live slots and tombstones, and stops at anything else.
+static inline bool DS_MapHashEndsProbe(const DS_MapRaw* map, uint32_t elem_hash) {
+	return elem_hash != DS_MAP_TOMBSTONE_HASH && !DS_MapHashIsLive(map, elem_hash);
+}
+
+static inline void DS_MapReserveRaw(DS_MapRaw* map, int count, int elem_size);
+static inline void DS_MapShrinkToFitRaw(DS_MapRaw* map, int elem_size);
+
 // * Return true if the key was newly added.
+// * The Ex versions take a precomputed hash. For DS_MapGetOrAddRawEx, the hash must have been passed through DS_MapFixHash.
 static inline bool DS_MapGetOrAddRaw(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
 static bool DS_MapGetOrAddRawEx(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash);
 
 // * Returns true if the key was found and removed.
 static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static inline bool DS_MapRemoveRawEx(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash);
 
 // `dst` must be an uninitialized map
 static inline void DS_MapInitCloneRaw(DS_MapRaw* map, DS_MapRaw* src, DS_Allocator* allocator, int elem_size);
 
 // * Returns true if the key was newly added
 static inline bool DS_MapInsertRaw(DS_MapRaw* map, const void* key, DS_OUT void* val, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static inline bool DS_MapInsertRawEx(DS_MapRaw* map, const void* key, DS_OUT void* val, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash);
 
 // * Returns true if the key was found.
 static inline bool DS_MapFindRaw(DS_MapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static inline bool DS_MapFindRawEx(DS_MapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash);
+
+// * out_val_ptrs and out_found may each be NULL. `keys` is an array of `count` keys.
+static void DS_MapFindNRaw(DS_MapRaw* map, const void* keys, int count, DS_OUT void** out_val_ptrs, DS_OUT bool* out_found, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
 
 // * Returns the address of the value if the key was found, otherwise NULL.
 static inline void* DS_MapFindPtrRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static inline void* DS_MapFindPtrRawEx(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash);
 
+#define DS_MAP_GROUP_SIZE 16
+#define DS_MAP_CTRL_EMPTY 0x80
+#define DS_MAP_CTRL_DELETED 0xFE
+
+// With DS_MapFlag_Groups, the control bytes are stored right after the elements in the same allocation.
+#define DS_MapCtrl(MAP, ELEM_SIZE) ((uint8_t*)(MAP)->data + (size_t)(MAP)->capacity * (ELEM_SIZE))
+#define DS_MapAllocSize(MAP, ELEM_SIZE) ((size_t)(MAP)->capacity * ((ELEM_SIZE) + ((MAP)->flags & DS_MapFlag_Groups ? 1 : 0)))
+
+// During an incremental migration, the iteration continues from the main table into the old table.
 static inline bool DS_MapIter(DS_MapRaw* map, int* i, void** out_key, void** out_value, int key_offset, int val_offset, int elem_size) {
 	char* elem_base;
+	bool groups = (map->flags & DS_MapFlag_Groups) != 0;
 	for (;;) {
-		if (*i >= map->capacity) return false;
+		char* data = (char*)map->data;
+		int capacity = map->capacity;
+		int slot = *i;
+		if (slot >= capacity) {
+			if (map->modes == NULL) return false;
+			data = (char*)map->modes->old_data;
+			capacity = map->modes->old_capacity;
+			slot -= map->capacity;
+			if (slot >= capacity) return false;
+		}
 
-		elem_base = (char*)map->data + (*i) * elem_size;
-		if (*(uint32_t*)elem_base == 0) {
+		elem_base = data + slot * elem_size;
+		bool is_empty = groups ? (data[capacity * elem_size + slot] & 0x80) != 0 : !DS_MapHashIsLive(map, *(uint32_t*)elem_base);
+		if (is_empty) {
 			*i = *i + 1;
 			continue;
 		}
@@ -400,19 +784,527 @@ static inline bool DS_MapIter(DS_MapRaw* map, int* i, void** out_key, void** out
 	return true;
 }
 
+// -- SoA map ----------------------------------------
+//
+// A hash map which stores the hashes, keys and values in three separate arrays (structure-of-arrays), instead of
+// interleaving them like DS_Map does. Probing only touches the hash and key arrays, and the value is only read on a hit,
+// so this is the better choice when the values are big (e.g. 64 bytes or more). It also avoids the padding that
+// DS_Map's element struct may need between the hash, the key and the value.
+//
+// The macros work the same way as the DS_Map macros.
+//
+// Example:
+//   DS_SoAMap(int, BigValue) map;
+//   DS_SoAMapInit(&map, allocator);
+//   
+//   int foo = 20;
+//   BigValue bar = ...;
+//   if (DS_SoAMapInsert(&map, foo, bar)) { /* This scope will run, because the key was newly added. */ }
+//   
+//   BigValue* bar_ptr = DS_SoAMapFindPtr(&map, foo);
+//   
+//   DS_ForSoAMapEach(int, BigValue, &map, it) {
+//      int key = *it.key;
+//      BigValue* value = it.value;
+//   }
+//   
+//   DS_SoAMapDeinit(&map);
+//
+
+#define DS_SoAMap(K, V) \
+	struct { DS_Allocator* allocator; uint32_t* hashes; K* keys; V* values; int32_t count; int32_t capacity; DS_MapHashFn hash_fn; }
+typedef DS_SoAMap(char, char) DS_SoAMapRaw;
+
+#define DS_SoAMapTypecheckK(MAP, PTR) ((PTR) == (MAP)->keys)
+#define DS_SoAMapTypecheckV(MAP, PTR) ((PTR) == (MAP)->values)
+#define DS_SoAMapKSize(MAP) sizeof(*(MAP)->keys)
+#define DS_SoAMapVSize(MAP) sizeof(*(MAP)->values)
+
+#define DS_SoAMapInit(MAP, ALLOCATOR)  DS_SoAMapInitRaw((DS_SoAMapRaw*)(MAP), (ALLOCATOR))
+
+// * Set the hash function of an empty map. See DS_MapHashFn.
+#define DS_SoAMapSetHashFn(MAP, HASH_FN) /* (DS_SoAMap(K, V)* MAP, DS_MapHashFn HASH_FN) */ do { \
+	DS_ASSERT((MAP)->count == 0); \
+	(MAP)->hash_fn = (HASH_FN); } while (0)
+
+// * Returns true if the key was found.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_SoAMapFind(MAP, KEY, OUT_VALUE) /* (DS_SoAMap(K, V)* MAP, K KEY, (optional null) V* OUT_VALUE) */ \
+	(DS_SoAMapTypecheckK((MAP), &(KEY)) && DS_SoAMapTypecheckV(MAP, OUT_VALUE), \
+	DS_SoAMapFindRaw((DS_SoAMapRaw*)(MAP), &(KEY), OUT_VALUE, DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)))
+
+// * Returns the address of the value if the key was found, otherwise NULL.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_SoAMapFindPtr(MAP, KEY) /* (DS_SoAMap(K, V)* MAP, K KEY) */ \
+	(DS_SoAMapTypecheckK((MAP), &(KEY)), \
+	DS_SoAMapFindPtrRaw((DS_SoAMapRaw*)(MAP), &(KEY), DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)))
+
+// * Returns true if the key was newly added.
+// * Existing keys get overwritten with the new value.
+// * KEY and VALUE must be l-values, otherwise this macro won't compile.
+#define DS_SoAMapInsert(MAP, KEY, VALUE) /* (DS_SoAMap(K, V)* MAP, K KEY, V VALUE) */ \
+	(DS_SoAMapTypecheckK(MAP, &(KEY)) && DS_SoAMapTypecheckV(MAP, &(VALUE)), \
+	DS_SoAMapInsertRaw((DS_SoAMapRaw*)(MAP), &(KEY), &(VALUE), DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)))
+
+// * Returns true if the key was newly added. The value of a new key is zero-initialized.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_SoAMapGetOrAddPtr(MAP, KEY, OUT_VALUE) /* (DS_SoAMap(K, V)* MAP, K KEY, V** OUT_VALUE) */ \
+	(DS_SoAMapTypecheckK(MAP, &(KEY)) && DS_SoAMapTypecheckV(MAP, *(OUT_VALUE)), \
+	DS_SoAMapGetOrAddRaw((DS_SoAMapRaw*)(MAP), &(KEY), (void**)(OUT_VALUE), DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)))
+
+// * Returns true if the key was found and removed.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_SoAMapRemove(MAP, KEY) /* (DS_SoAMap(K, V)* MAP, K KEY) */ \
+	(DS_SoAMapTypecheckK(MAP, &(KEY)), \
+	DS_SoAMapRemoveRaw((DS_SoAMapRaw*)(MAP), &(KEY), DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)))
+
+#define DS_SoAMapClear(MAP) \
+	DS_SoAMapClearRaw((DS_SoAMapRaw*)(MAP))
+
+// * Reset the map to a default state and free its memory.
+#define DS_SoAMapDeinit(MAP) \
+	DS_SoAMapDeinitRaw((DS_SoAMapRaw*)(MAP), DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP))
+
+#define DS_ForSoAMapEach(K, V, MAP, IT) /* (type K, type V, DS_SoAMap(K, V)* MAP, name IT) */ \
+	struct DS_Concat(_dummy_, __LINE__) { int i_next; K *key; V *value; }; \
+	if ((MAP)->count > 0) for (struct DS_Concat(_dummy_, __LINE__) IT = {0}; \
+		DS_SoAMapIter((DS_SoAMapRaw*)(MAP), &IT.i_next, (void**)&IT.key, (void**)&IT.value, DS_SoAMapKSize(MAP), DS_SoAMapVSize(MAP)); )
+
+static inline void DS_SoAMapInitRaw(DS_SoAMapRaw* map, DS_Allocator* allocator);
+static inline void DS_SoAMapClearRaw(DS_SoAMapRaw* map);
+static void DS_SoAMapDeinitRaw(DS_SoAMapRaw* map, int K_size, int V_size);
+static void* DS_SoAMapFindPtrRaw(DS_SoAMapRaw* map, const void* key, int K_size, int V_size);
+static inline bool DS_SoAMapFindRaw(DS_SoAMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size);
+static bool DS_SoAMapGetOrAddRaw(DS_SoAMapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size);
+static inline bool DS_SoAMapInsertRaw(DS_SoAMapRaw* map, const void* key, const void* val, int K_size, int V_size);
+static bool DS_SoAMapRemoveRaw(DS_SoAMapRaw* map, const void* key, int K_size, int V_size);
+
+static inline bool DS_SoAMapIter(DS_SoAMapRaw* map, int* i, void** out_key, void** out_value, int K_size, int V_size) {
+	for (; *i < map->capacity; *i = *i + 1) {
+		if (map->hashes[*i] != 0) {
+			*out_key = (char*)map->keys + *i * K_size;
+			*out_value = (char*)map->values + *i * V_size;
+			*i = *i + 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+// -- Ordered map ----------------------------------------
+//
+// A hash map which stores its entries densely in insertion order, with a separate open-addressing table of indices
+// into the entries. Iterating is a linear scan over `count` entries, rather than over the whole capacity like with DS_Map.
+// The first four members are laid out like a DS_DynArray, so `map.data[i].key` and `map.data[i].value` can be accessed directly.
+//
+// * DS_OrderedMapRemove moves the last entry into the removed entry's place, which is O(1), but changes the order.
+//   Entries which are never removed stay in insertion order.
+// * Pointers into the entries are invalidated by any insert or remove.
+//
+// Example:
+//   DS_OrderedMap(int, float) map;
+//   DS_OrderedMapInit(&map, allocator);
+//   
+//   int foo = 20;
+//   float bar = 0.7f;
+//   DS_OrderedMapInsert(&map, foo, bar);
+//   
+//   DS_ForOrderedMapEach(int, float, &map, it) {
+//      int key = *it.key;
+//      float value = *it.value;
+//   }
+//   
+//   DS_OrderedMapDeinit(&map);
+//
+
+#define DS_OrderedMap(K, V) \
+	struct { DS_Allocator* allocator; struct{ K key; V value; }* data; int32_t count; int32_t capacity; \
+	uint64_t* slots; int32_t slot_capacity; DS_MapHashFn hash_fn; }
+typedef DS_OrderedMap(char, char) DS_OrderedMapRaw;
+
+#define DS_OrderedMapInit(MAP, ALLOCATOR)  DS_OrderedMapInitRaw((DS_OrderedMapRaw*)(MAP), (ALLOCATOR))
+
+// * Set the hash function of an empty map. See DS_MapHashFn.
+#define DS_OrderedMapSetHashFn(MAP, HASH_FN) /* (DS_OrderedMap(K, V)* MAP, DS_MapHashFn HASH_FN) */ do { \
+	DS_ASSERT((MAP)->count == 0); \
+	(MAP)->hash_fn = (HASH_FN); } while (0)
+
+// * Returns true if the key was found.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_OrderedMapFind(MAP, KEY, OUT_VALUE) /* (DS_OrderedMap(K, V)* MAP, K KEY, (optional null) V* OUT_VALUE) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)) && DS_MapTypecheckV(MAP, OUT_VALUE), \
+	DS_OrderedMapFindRaw((DS_OrderedMapRaw*)(MAP), &(KEY), OUT_VALUE, DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
+// * Returns the index of the entry if the key was found, otherwise -1.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_OrderedMapFindIndex(MAP, KEY) /* (DS_OrderedMap(K, V)* MAP, K KEY) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)), \
+	DS_OrderedMapFindIndexRaw((DS_OrderedMapRaw*)(MAP), &(KEY), DS_MapKSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP)))
+
+// * Returns the address of the value if the key was found, otherwise NULL.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_OrderedMapFindPtr(MAP, KEY) /* (DS_OrderedMap(K, V)* MAP, K KEY) */ \
+	(DS_MapTypecheckK((MAP), &(KEY)), \
+	DS_OrderedMapFindPtrRaw((DS_OrderedMapRaw*)(MAP), &(KEY), DS_MapKSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
+// * Returns true if the key was newly added.
+// * Existing keys get overwritten with the new value.
+// * KEY and VALUE must be l-values, otherwise this macro won't compile.
+#define DS_OrderedMapInsert(MAP, KEY, VALUE) /* (DS_OrderedMap(K, V)* MAP, K KEY, V VALUE) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)) && DS_MapTypecheckV(MAP, &(VALUE)), \
+	DS_OrderedMapInsertRaw((DS_OrderedMapRaw*)(MAP), &(KEY), &(VALUE), DS_MapKSize(MAP), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
+// * Returns true if the key was newly added to the end of the entries. The value of a new key is zero-initialized.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_OrderedMapGetOrAddPtr(MAP, KEY, OUT_VALUE) /* (DS_OrderedMap(K, V)* MAP, K KEY, V** OUT_VALUE) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)) && DS_MapTypecheckV(MAP, *(OUT_VALUE)), \
+	DS_OrderedMapGetOrAddRaw((DS_OrderedMapRaw*)(MAP), &(KEY), (void**)(OUT_VALUE), DS_MapKSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP), DS_MapVOffset(MAP)))
+
+// * Returns true if the key was found and removed.
+// * The last entry is moved into the place of the removed entry.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_OrderedMapRemove(MAP, KEY) /* (DS_OrderedMap(K, V)* MAP, K KEY) */ \
+	(DS_MapTypecheckK(MAP, &(KEY)), \
+	DS_OrderedMapRemoveRaw((DS_OrderedMapRaw*)(MAP), &(KEY), DS_MapKSize(MAP), DS_MapElemSize(MAP), DS_MapKOffset(MAP)))
+
+#define DS_OrderedMapClear(MAP) \
+	DS_OrderedMapClearRaw((DS_OrderedMapRaw*)(MAP))
+
+// * Reset the map to a default state and free its memory.
+#define DS_OrderedMapDeinit(MAP) \
+	DS_OrderedMapDeinitRaw((DS_OrderedMapRaw*)(MAP), DS_MapElemSize(MAP))
+
+#define DS_ForOrderedMapEach(K, V, MAP, IT) /* (type K, type V, DS_OrderedMap(K, V)* MAP, name IT) */ \
+	struct DS_Concat(_dummy_, __LINE__) { int i; K *key; V *value; }; \
+	for (struct DS_Concat(_dummy_, __LINE__) IT = {0}; \
+		IT.i < (MAP)->count && (IT.key = &(MAP)->data[IT.i].key, IT.value = &(MAP)->data[IT.i].value, true); IT.i++)
+
+static inline void DS_OrderedMapInitRaw(DS_OrderedMapRaw* map, DS_Allocator* allocator);
+static inline void DS_OrderedMapClearRaw(DS_OrderedMapRaw* map);
+static void DS_OrderedMapDeinitRaw(DS_OrderedMapRaw* map, int elem_size);
+static int DS_OrderedMapFindIndexRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset);
+static inline void* DS_OrderedMapFindPtrRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset, int val_offset);
+static inline bool DS_OrderedMapFindRaw(DS_OrderedMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static bool DS_OrderedMapGetOrAddRaw(DS_OrderedMapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int elem_size, int key_offset, int val_offset);
+static inline bool DS_OrderedMapInsertRaw(DS_OrderedMapRaw* map, const void* key, const void* val, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static bool DS_OrderedMapRemoveRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset);
+
+// -- String map ----------------------------------------
+//
+// A hash map keyed by variable-length byte strings. The bytes of each key are copied into an arena owned by the map,
+// so the caller doesn't need to keep them alive. The full hash and the length of each key are stored next to it,
+// so a lookup only compares the key bytes of slots that are very likely to be a match.
+//
+// The key arguments of the macros below can be any struct with `data` and `size` members, e.g. STR_View.
+//
+// Example:
+//   DS_StrMap(int) map;
+//   DS_StrMapInit(&map, allocator);
+//   
+//   STR_View name = STR_V("foo");
+//   int value = 20;
+//   if (DS_StrMapInsert(&map, name, value)) { /* This scope will run, because the key was newly added. */ }
+//   
+//   int result;
+//   if (DS_StrMapFind(&map, name, &result)) { /* This scope will run and result will be 20. */ }
+//   
+//   /* Iterate through the key-value pairs */
+//   DS_ForStrMapEach(int, &map, it) {
+//      STR_View key = {it.key->data, it.key->size};
+//      int value = *it.value;
+//   }
+//   
+//   DS_StrMapDeinit(&map);
+//
+// Removing a key doesn't free its interned bytes; they're only released by DS_StrMapClear and DS_StrMapDeinit.
+//
+// The KEY argument of the macros below is evaluated twice, as (KEY).data and (KEY).size, so it must not have side
+// effects. Pass a variable or STR_V("..."), not e.g. a function call that builds the string.
+//
+
+// Interned keys are null-terminated, so `data` may also be used as a C-string.
+typedef struct DS_StrMapKey {
+	uint32_t hash; // 0 means an empty slot
+	uint32_t size;
+	const char* data;
+} DS_StrMapKey;
+
+#ifndef DS_STR_MAP_KEY_ARENA_BLOCK_SIZE
+#define DS_STR_MAP_KEY_ARENA_BLOCK_SIZE DS_KIB(16)
+#endif
+
+#define DS_StrMap(V) \
+	struct { DS_Allocator* allocator; struct{ DS_StrMapKey key; V value; }* data; int32_t count; int32_t capacity; DS_MapHashFn hash_fn; DS_Arena key_arena; }
+typedef DS_StrMap(char) DS_StrMapRaw;
+
+#define DS_StrMapInit(MAP, ALLOCATOR)  DS_StrMapInitRaw((DS_StrMapRaw*)(MAP), (ALLOCATOR))
+
+// * Set the hash function of an empty map. See DS_MapHashFn.
+#define DS_StrMapSetHashFn(MAP, HASH_FN) /* (DS_StrMap(V)* MAP, DS_MapHashFn HASH_FN) */ do { \
+	DS_ASSERT((MAP)->count == 0); \
+	(MAP)->hash_fn = (HASH_FN); } while (0)
+
+// * Returns true if the key was found.
+#define DS_StrMapFind(MAP, KEY, OUT_VALUE) /* (DS_StrMap(V)* MAP, STR_View KEY, (optional null) V* OUT_VALUE) */ \
+	(DS_MapTypecheckV(MAP, OUT_VALUE), \
+	DS_StrMapFindRaw((DS_StrMapRaw*)(MAP), (KEY).data, (KEY).size, OUT_VALUE, DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapVOffset(MAP)))
+
+// * Returns the address of the value if the key was found, otherwise NULL.
+#define DS_StrMapFindPtr(MAP, KEY) /* (DS_StrMap(V)* MAP, STR_View KEY) */ \
+	DS_StrMapFindPtrRaw((DS_StrMapRaw*)(MAP), (KEY).data, (KEY).size, DS_MapElemSize(MAP), DS_MapVOffset(MAP))
+
+// * Returns true if the key was newly added.
+// * Existing keys get overwritten with the new value.
+// * VALUE must be an l-value, otherwise this macro won't compile.
+#define DS_StrMapInsert(MAP, KEY, VALUE) /* (DS_StrMap(V)* MAP, STR_View KEY, V VALUE) */ \
+	(DS_MapTypecheckV(MAP, &(VALUE)), \
+	DS_StrMapInsertRaw((DS_StrMapRaw*)(MAP), (KEY).data, (KEY).size, &(VALUE), DS_MapVSize(MAP), DS_MapElemSize(MAP), DS_MapVOffset(MAP)))
+
+// * Returns true if the key was newly added. The value of a new key is zero-initialized.
+// * OUT_KEY may be NULL. Otherwise, it's set to the interned key, which stays valid until the map is cleared,
+//   so it can be used e.g. as a stable identifier in a symbol table.
+#define DS_StrMapGetOrAddPtr(MAP, KEY, OUT_VALUE, OUT_KEY) /* (DS_StrMap(V)* MAP, STR_View KEY, V** OUT_VALUE, (optional null) const DS_StrMapKey** OUT_KEY) */ \
+	(DS_MapTypecheckV(MAP, *(OUT_VALUE)), \
+	DS_StrMapGetOrAddRaw((DS_StrMapRaw*)(MAP), (KEY).data, (KEY).size, (void**)(OUT_VALUE), (OUT_KEY), DS_MapElemSize(MAP), DS_MapVOffset(MAP)))
+
+// * Returns true if the key was found and removed.
+#define DS_StrMapRemove(MAP, KEY) /* (DS_StrMap(V)* MAP, STR_View KEY) */ \
+	DS_StrMapRemoveRaw((DS_StrMapRaw*)(MAP), (KEY).data, (KEY).size, DS_MapElemSize(MAP))
+
+// * Remove all keys and release the interned key bytes, but keep the table memory.
+#define DS_StrMapClear(MAP) \
+	DS_StrMapClearRaw((DS_StrMapRaw*)(MAP), DS_MapElemSize(MAP))
+
+// * Reset the map to a default state and free all of its memory.
+#define DS_StrMapDeinit(MAP) \
+	DS_StrMapDeinitRaw((DS_StrMapRaw*)(MAP), DS_MapElemSize(MAP))
+
+#define DS_ForStrMapEach(V, MAP, IT) /* (type V, DS_StrMap(V)* MAP, name IT) */ \
+	struct DS_Concat(_dummy_, __LINE__) { int i_next; DS_StrMapKey *key; V *value; }; \
+	if ((MAP)->count > 0) for (struct DS_Concat(_dummy_, __LINE__) IT = {0}; \
+		DS_StrMapIter((DS_StrMapRaw*)(MAP), &IT.i_next, (void**)&IT.key, (void**)&IT.value, DS_MapVOffset(MAP), DS_MapElemSize(MAP)); )
+
+static void DS_StrMapInitRaw(DS_StrMapRaw* map, DS_Allocator* allocator);
+static void DS_StrMapDeinitRaw(DS_StrMapRaw* map, int elem_size);
+static void DS_StrMapClearRaw(DS_StrMapRaw* map, int elem_size);
+static void* DS_StrMapFindPtrRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, int elem_size, int val_offset);
+static bool DS_StrMapFindRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, DS_OUT void* out_val, int V_size, int elem_size, int val_offset);
+static bool DS_StrMapGetOrAddRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, DS_OUT void** out_val_ptr, DS_OUT const DS_StrMapKey** out_key, int elem_size, int val_offset);
+static bool DS_StrMapInsertRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, const void* val, int V_size, int elem_size, int val_offset);
+static bool DS_StrMapRemoveRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, int elem_size);
+
+static inline bool DS_StrMapIter(DS_StrMapRaw* map, int* i, void** out_key, void** out_value, int val_offset, int elem_size) {
+	for (; *i < map->capacity; *i = *i + 1) {
+		char* elem_base = (char*)map->data + *i * elem_size;
+		if (*(uint32_t*)elem_base != 0) {
+			*out_key = elem_base;
+			*out_value = elem_base + val_offset;
+			*i = *i + 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+// -- Concurrent map ----------------------------------------
+//
+// A hash map which can be used from many threads at once, meant for read-mostly lookup tables.
+// * Lookups are lock-free and don't write to any shared cache line, so they scale with the number of cores.
+// * Writers are striped over DS_CMAP_SHARD_COUNT shards by the top bits of the hash, each with its own spin lock.
+// * When a shard grows, the old table is retired and freed once no reader can be looking at it anymore.
+//   Readers announce themselves in per-thread striped counters for the current epoch, and the epoch only advances
+//   when the counters of the previous epoch are all zero.
+// * Values are read and written through a per-slot sequence counter, so a lookup never observes a half-written value.
+//   For this reason, there's no equivalent of DS_MapGetOrAddPtr that would hand out a pointer into the table;
+//   DS_CMapGetOrAdd copies the value in or out instead.
+// * The allocator must be thread-safe, e.g. the heap allocator.
+//
+// Example:
+//   DS_ConcurrentMap(int, float)* map = ... // This struct is big, so it's best to not place it on the stack
+//   DS_CMapInit(map, heap_allocator);
+//   
+//   int foo = 20;
+//   float bar = 0.7f;
+//   DS_CMapInsert(map, foo, bar);          /* On any thread */
+//   
+//   float result;
+//   if (DS_CMapFind(map, foo, &result)) {  /* On any thread */ }
+//   
+//   DS_CMapDeinit(map);                    /* Once no thread is using the map anymore */
+//
+
+#ifndef DS_CMAP_SHARD_BITS
+#define DS_CMAP_SHARD_BITS 6
+#endif
+#define DS_CMAP_SHARD_COUNT (1 << DS_CMAP_SHARD_BITS)
+
+#ifndef DS_CMAP_READER_STRIPES
+#define DS_CMAP_READER_STRIPES 64
+#endif
+
+#define DS_CACHE_LINE_SIZE 64
+
+typedef struct DS_CMapTable {
+	uint32_t capacity;
+	uint32_t retire_epoch;
+	struct DS_CMapTable* retired_next;
+	// Followed by the elements. Each element is of the form { uint32_t hash; uint32_t seq; K key; V value; }.
+	// Hash 0 means an empty slot and DS_MAP_TOMBSTONE_HASH a removed slot. Slots are never reused within a table.
+} DS_CMapTable;
+
+typedef struct DS_CMapShard {
+	DS_CMapTable* volatile table; // may be NULL
+	DS_SpinLock lock;
+	uint32_t count;
+	uint32_t used; // number of non-empty slots, including removed slots
+	char pad[DS_CACHE_LINE_SIZE - sizeof(void*) - 3 * sizeof(uint32_t)];
+} DS_CMapShard;
+
+typedef struct DS_CMapReaderCounter {
+	volatile uint32_t count;
+	char pad[DS_CACHE_LINE_SIZE - sizeof(uint32_t)];
+} DS_CMapReaderCounter;
+
+typedef struct DS_ConcurrentMapRaw {
+	DS_Allocator* allocator;
+	DS_MapHashFn hash_fn;
+	DS_CMapShard shards[DS_CMAP_SHARD_COUNT];
+	DS_CMapReaderCounter readers[2][DS_CMAP_READER_STRIPES]; // indexed by [epoch & 1][reader stripe]
+	volatile uint32_t epoch;
+	DS_SpinLock retired_lock;
+	DS_CMapTable* retired;
+} DS_ConcurrentMapRaw;
+
+#define DS_ConcurrentMap(K, V) \
+	struct { DS_ConcurrentMapRaw raw; struct { uint32_t hash; uint32_t seq; K key; V value; }* elem_type; }
+
+#define DS_CMapTypecheckK(MAP, PTR) ((PTR) == &(MAP)->elem_type->key)
+#define DS_CMapTypecheckV(MAP, PTR) ((PTR) == &(MAP)->elem_type->value)
+#define DS_CMapKSize(MAP) sizeof((MAP)->elem_type->key)
+#define DS_CMapVSize(MAP) sizeof((MAP)->elem_type->value)
+#define DS_CMapElemSize(MAP) sizeof(*(MAP)->elem_type)
+#define DS_CMapKOffset(MAP) (int)((uintptr_t)&(MAP)->elem_type->key - (uintptr_t)(MAP)->elem_type)
+#define DS_CMapVOffset(MAP) (int)((uintptr_t)&(MAP)->elem_type->value - (uintptr_t)(MAP)->elem_type)
+
+#define DS_CMapInit(MAP, ALLOCATOR)  DS_CMapInitRaw(&(MAP)->raw, (ALLOCATOR))
+
+// * Set the hash function of an empty map. See DS_MapHashFn.
+#define DS_CMapSetHashFn(MAP, HASH_FN) /* (DS_ConcurrentMap(K, V)* MAP, DS_MapHashFn HASH_FN) */ do { \
+	DS_ASSERT(DS_CMapCountRaw(&(MAP)->raw) == 0); \
+	(MAP)->raw.hash_fn = (HASH_FN); } while (0)
+
+// * Returns true if the key was found. OUT_VALUE may be NULL.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_CMapFind(MAP, KEY, OUT_VALUE) /* (DS_ConcurrentMap(K, V)* MAP, K KEY, (optional null) V* OUT_VALUE) */ \
+	(DS_CMapTypecheckK((MAP), &(KEY)) && DS_CMapTypecheckV(MAP, OUT_VALUE), \
+	DS_CMapFindRaw(&(MAP)->raw, &(KEY), (OUT_VALUE), DS_CMapKSize(MAP), DS_CMapVSize(MAP), DS_CMapElemSize(MAP), DS_CMapKOffset(MAP), DS_CMapVOffset(MAP)))
+
+// * Returns true if the key was newly added.
+// * Existing keys get overwritten with the new value.
+// * KEY and VALUE must be l-values, otherwise this macro won't compile.
+#define DS_CMapInsert(MAP, KEY, VALUE) /* (DS_ConcurrentMap(K, V)* MAP, K KEY, V VALUE) */ \
+	(DS_CMapTypecheckK((MAP), &(KEY)) && DS_CMapTypecheckV(MAP, &(VALUE)), \
+	DS_CMapGetOrAddRaw(&(MAP)->raw, &(KEY), &(VALUE), NULL, true, DS_CMapKSize(MAP), DS_CMapVSize(MAP), DS_CMapElemSize(MAP), DS_CMapKOffset(MAP), DS_CMapVOffset(MAP)))
+
+// * Returns true if the key was newly added with the value INIT_VALUE.
+// * If the key already exists, its current value is written to OUT_VALUE (which may be NULL) and the map isn't modified.
+// * KEY and INIT_VALUE must be l-values, otherwise this macro won't compile.
+#define DS_CMapGetOrAdd(MAP, KEY, INIT_VALUE, OUT_VALUE) /* (DS_ConcurrentMap(K, V)* MAP, K KEY, V INIT_VALUE, (optional null) V* OUT_VALUE) */ \
+	(DS_CMapTypecheckK((MAP), &(KEY)) && DS_CMapTypecheckV(MAP, &(INIT_VALUE)) && DS_CMapTypecheckV(MAP, (OUT_VALUE)), \
+	DS_CMapGetOrAddRaw(&(MAP)->raw, &(KEY), &(INIT_VALUE), (OUT_VALUE), false, DS_CMapKSize(MAP), DS_CMapVSize(MAP), DS_CMapElemSize(MAP), DS_CMapKOffset(MAP), DS_CMapVOffset(MAP)))
+
+// * Returns true if the key was found and removed.
+// * KEY must be an l-value, otherwise this macro won't compile.
+#define DS_CMapRemove(MAP, KEY) /* (DS_ConcurrentMap(K, V)* MAP, K KEY) */ \
+	(DS_CMapTypecheckK((MAP), &(KEY)), \
+	DS_CMapRemoveRaw(&(MAP)->raw, &(KEY), DS_CMapKSize(MAP), DS_CMapElemSize(MAP), DS_CMapKOffset(MAP)))
+
+// * Returns the number of keys in the map. This is only a snapshot if other threads are modifying the map.
+#define DS_CMapCount(MAP) DS_CMapCountRaw(&(MAP)->raw)
+
+// * Try to free retired tables. This also happens automatically whenever a shard grows.
+#define DS_CMapCollect(MAP) DS_CMapCollectRaw(&(MAP)->raw)
+
+// * Free all memory. No other thread may be using the map.
+#define DS_CMapDeinit(MAP) DS_CMapDeinitRaw(&(MAP)->raw)
+
+static void DS_CMapInitRaw(DS_ConcurrentMapRaw* map, DS_Allocator* allocator);
+static void DS_CMapDeinitRaw(DS_ConcurrentMapRaw* map);
+static bool DS_CMapFindRaw(DS_ConcurrentMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static bool DS_CMapGetOrAddRaw(DS_ConcurrentMapRaw* map, const void* key, const void* val, DS_OUT void* out_val, bool overwrite, int K_size, int V_size, int elem_size, int key_offset, int val_offset);
+static bool DS_CMapRemoveRaw(DS_ConcurrentMapRaw* map, const void* key, int K_size, int elem_size, int key_offset);
+static int DS_CMapCountRaw(DS_ConcurrentMapRaw* map);
+static void DS_CMapCollectRaw(DS_ConcurrentMapRaw* map);
+
 // -- Arena ------------------------------------------
 
 DS_API void DS_ArenaInit(DS_Arena* arena, size_t block_size, DS_Allocator* allocator);
 DS_API void DS_ArenaDeinit(DS_Arena* arena);
 
+#ifndef DS_NO_VIRTUAL_MEMORY
+// Granularity at which a virtual memory arena commits memory. Must be a multiple of the OS page size.
+#ifndef DS_ARENA_COMMIT_SIZE
+#define DS_ARENA_COMMIT_SIZE DS_KIB(64)
+#endif
+
+// DS_ArenaSetMark and DS_ArenaReset decommit the memory above the mark once more than this much of it is committed.
+#ifndef DS_ARENA_DECOMMIT_THRESHOLD
+#define DS_ARENA_DECOMMIT_THRESHOLD DS_MIB(1)
+#endif
+
+// Huge page size (and alignment) used by DS_ArenaFlag_HugePages on non-Windows targets.
+#ifndef DS_ARENA_HUGE_PAGE_SIZE
+#define DS_ARENA_HUGE_PAGE_SIZE DS_MIB(2)
+#endif
+
+// Initialize an arena which reserves `reserve_size` bytes of contiguous address space up front, and commits pages of it
+// as the mark advances. Pushing is then a pointer bump with an occasional commit, and nothing is ever copied or wasted
+// at block boundaries. Reserving e.g. 64 GB of address space costs nothing on 64-bit targets.
+// A push returns NULL if it doesn't fit in the reserved range or if the OS refuses to commit its pages. If the
+// reservation itself fails, the arena is left empty and every push returns NULL.
+DS_API void DS_ArenaInitVirtual(DS_Arena* arena, size_t reserve_size, DS_Info* ds);
+
+// Same as DS_ArenaInitVirtual, but with DS_ArenaFlags. Flags that the OS can't honor are ignored, and the arena
+// falls back to regular pages. Returns the flags that were honored; these are also stored in `arena->flags`.
+DS_API DS_ArenaFlags DS_ArenaInitVirtualEx(DS_Arena* arena, size_t reserve_size, DS_ArenaFlags flags, DS_Info* ds);
+#endif
+
 DS_API char* DS_ArenaPush(DS_Arena* arena, size_t size);
+
+// Same as DS_ArenaPush, but the memory is zeroed. A virtual memory arena skips the part that has never been handed
+// out, since fresh pages from the OS are already zero. Regular arenas always clear the whole allocation, as their
+// blocks come from a DS_Allocator and may hold anything.
 DS_API char* DS_ArenaPushZero(DS_Arena* arena, size_t size);
+
+// `alignment` can be any power of 2. Alignments larger than DS_ARENA_BLOCK_ALIGNMENT may waste up to `alignment` bytes per new block.
 DS_API char* DS_ArenaPushAligned(DS_Arena* arena, size_t size, size_t alignment);
 
 DS_API DS_ArenaMark DS_ArenaGetMark(DS_Arena* arena);
 DS_API void DS_ArenaSetMark(DS_Arena* arena, DS_ArenaMark mark);
 DS_API void DS_ArenaReset(DS_Arena* arena);
 
+// By default, DS_ArenaReset frees every block except the first one, which is kept unless it's larger than the block size.
+// An arena that is reset periodically, e.g. once per frame, can instead keep more of its memory around for reuse:
+// DS_ArenaReset then keeps blocks totalling up to `retain_size` bytes, or up to the highest memory use seen in
+// roughly the last `retain_resets` resets (the larger of the two), and only frees the excess. Pass 0 to disable either.
+// For virtual memory arenas, this is how much memory stays committed instead.
+DS_API void DS_ArenaSetRetention(DS_Arena* arena, size_t retain_size, int retain_resets);
+
+// By default, every new block is `block_size` bytes. Setting a larger max block size makes each new block twice as large
+// as the previous one, up to `max_block_size`, so that an arena which grows big needs only O(log n) blocks while a
+// small arena still stays small. When DS_ArenaReset frees blocks, the growth restarts after the blocks it keeps.
+DS_API void DS_ArenaSetMaxBlockSize(DS_Arena* arena, size_t max_block_size);
+
+#ifdef DS_ARENA_STATS
+// Arena instrumentation is compiled in only when DS_ARENA_STATS is defined, and costs nothing otherwise. It tracks
+// peak usage, alignment padding and block tail waste, and the bytes pushed per call site (file and line).
+// Call sites are captured by the DS_ArenaPush, DS_ArenaPushZero, DS_ArenaPushAligned and DS_New macros defined at the
+// end of this file; pushes made through an allocator proc (e.g. DS_DynArray growth) are accounted to a NULL site.
+//
+// Returns a human-readable report, or a JSON object if `json` is true, as a null-terminated string allocated from `out`.
+DS_API char* DS_ArenaStatsDump(DS_Arena* arena, DS_Arena* out, bool json);
+#endif
+
 // -- Scope ------------------------------------------
 
 // DS_Scope provides convenience functions for storing an arena mark as a local and
@@ -447,7 +1339,374 @@ static inline void DS_ScopePop(DS_Scope scope) {
 	}
 }
 
-// -- Memory allocation --------------------------------
+// -- Scratch arenas ---------------------------------
+//
+// Each thread has its own small pool of scratch arenas, created lazily on first use. DS_ScratchBegin returns a scope
+// into a scratch arena that is guaranteed to differ from the given conflicting arena(s), so a function can allocate
+// temporaries without locking and without clobbering an output arena that itself happens to be a scratch arena of
+// the caller. Pass every arena that must outlive the scope as a conflict.
+//
+// e.g.
+//   DS_Scope scratch = DS_ScratchBegin(out_arena);
+//   int* tmp = DS_ArenaPush(scratch.temp_arena, 1000 * sizeof(int));
+//   ...
+//   DS_ScratchEnd(scratch);
+
+#if !defined(DS_NO_VIRTUAL_MEMORY) || !defined(DS_NO_MALLOC)
+
+#ifndef DS_SCRATCH_ARENA_COUNT
+#define DS_SCRATCH_ARENA_COUNT 2 // At most DS_SCRATCH_ARENA_COUNT - 1 conflicts can be passed.
+#endif
+
+#ifdef DS_NO_VIRTUAL_MEMORY
+#ifndef DS_SCRATCH_ARENA_BLOCK_SIZE
+#define DS_SCRATCH_ARENA_BLOCK_SIZE DS_KIB(64)
+#endif
+#else
+// Address space reserved by each scratch arena.
+#ifndef DS_SCRATCH_ARENA_RESERVE_SIZE
+#define DS_SCRATCH_ARENA_RESERVE_SIZE (sizeof(void*) >= 8 ? DS_GIB(64) : DS_MIB(64))
+#endif
+#endif
+
+DS_API DS_Scope DS_ScratchBeginN(DS_Arena* const* conflicts, int conflicts_count);
+
+static inline DS_Scope DS_ScratchBegin(DS_Arena* conflict) {
+	return DS_ScratchBeginN(&conflict, conflict ? 1 : 0);
+}
+
+static inline void DS_ScratchEnd(DS_Scope scope) {
+	DS_ArenaSetMark(scope.temp_arena, scope.reset_to);
+}
+
+// Frees the calling thread's scratch arenas. Call this before a thread that has used scratch arenas exits.
+DS_API void DS_ScratchThreadDeinit(void);
+
+#endif
+
+// -- Concurrent arena -------------------------------
+//
+// DS_ConcurrentArena is an arena that any number of threads can push into at the same time without locking, e.g. to
+// have worker threads append results into one shared output region. A push is a single atomic fetch-add on the current
+// block's cursor; only installing a new block goes through a compare-exchange. Individual allocations can't be freed,
+// and DS_ConcurrentArenaReset / DS_ConcurrentArenaDeinit must not run concurrently with pushes.
+//
+// A pointer to a DS_ConcurrentArena can be cast to DS_Allocator* to allocate data structures from it.
+
+typedef struct DS_ConcurrentArenaBlock {
+	struct DS_ConcurrentArenaBlock* next; // older block, may be NULL
+	size_t size_including_header;
+	volatile uint64_t used; // number of bytes handed out after the header. May overshoot the block size when the block fills up.
+} DS_ConcurrentArenaBlock;
+
+typedef struct DS_ConcurrentArena {
+	union {
+		DS_AllocatorBase base;
+		struct DS_Info* ds;
+	};
+	DS_Allocator* allocator;
+	size_t block_size;
+	DS_ConcurrentArenaBlock* volatile current_block; // may be NULL
+	DS_ConcurrentArenaBlock* volatile large_blocks; // dedicated blocks for pushes larger than block_size / 4
+	volatile uint64_t total_mem_reserved;
+} DS_ConcurrentArena;
+
+DS_API void DS_ConcurrentArenaInit(DS_ConcurrentArena* arena, size_t block_size, DS_Allocator* allocator);
+DS_API void DS_ConcurrentArenaDeinit(DS_ConcurrentArena* arena);
+
+DS_API char* DS_ConcurrentArenaPush(DS_ConcurrentArena* arena, size_t size);
+DS_API char* DS_ConcurrentArenaPushZero(DS_ConcurrentArena* arena, size_t size);
+DS_API char* DS_ConcurrentArenaPushAligned(DS_ConcurrentArena* arena, size_t size, size_t alignment);
+
+// Frees all blocks except the most recent one, which is kept for reuse.
+DS_API void DS_ConcurrentArenaReset(DS_ConcurrentArena* arena);
+
+// -- Pool -------------------------------------------
+//
+// DS_Pool is an allocator for elements of a single size, with O(1) allocation and freeing. Elements are carved out of
+// slabs allocated from a parent allocator, and freed elements are linked into an intrusive free list.
+//
+// A pointer to a DS_Pool can be cast to DS_Allocator* to pass it to data structures, as long as every allocation they
+// make fits in one element. Resizing within an element returns the same pointer. So it only serves fixed-size,
+// single-element allocations, e.g. the nodes of a linked list or tree, and can't back anything that grows its buffer,
+// such as a DS_DynArray, DS_Map or STR_Builder. Larger allocations assert rather than go to the parent allocator, since
+// the pool couldn't tell on free whether a pointer is one of its elements or the parent's.
+//
+// e.g.
+//   DS_Pool pool;
+//   DS_PoolInit(&pool, sizeof(Node), 8, heap);
+//   Node* node = (Node*)DS_PoolAlloc(&pool);
+//   DS_PoolFree(&pool, node);
+//   DS_PoolDeinit(&pool);
+
+#ifndef DS_POOL_SLAB_SIZE
+#define DS_POOL_SLAB_SIZE DS_KIB(64) // Slabs are made larger when needed to fit at least one element
+#endif
+
+typedef struct DS_PoolSlab {
+	struct DS_PoolSlab* next;
+} DS_PoolSlab;
+
+typedef struct DS_Pool {
+	union {
+		DS_AllocatorBase base;
+		struct DS_Info* ds;
+	};
+	DS_Allocator* allocator;
+	size_t elem_size; // rounded up to elem_alignment, and to at least the size of a pointer
+	size_t elem_alignment;
+	size_t slab_size;
+	void* free_list;
+	DS_PoolSlab* slabs;
+	char* slab_ptr; // Elements in the newest slab are handed out lazily from [slab_ptr, slab_end)
+	char* slab_end;
+	size_t count; // number of allocated elements
+} DS_Pool;
+
+DS_API void DS_PoolInit(DS_Pool* pool, size_t elem_size, size_t elem_alignment, DS_Allocator* allocator);
+DS_API void DS_PoolDeinit(DS_Pool* pool);
+DS_API void* DS_PoolAlloc(DS_Pool* pool);
+DS_API void DS_PoolFree(DS_Pool* pool, void* elem);
+
+// Frees every element at once, but keeps the slabs for reuse.
+DS_API void DS_PoolReset(DS_Pool* pool);
+
+// -- TLSF -------------------------------------------
+//
+// DS_TLSF is a general-purpose allocator with O(1) worst-case allocation, freeing and resizing, using the two-level
+// segregated fit algorithm. It's meant for threads with latency requirements, where the system allocator's
+// unbounded worst case isn't acceptable. It's not thread-safe.
+//
+// Memory is managed in regions. Regions can be added explicitly with DS_TLSFAddRegion, e.g. a buffer reserved up front or
+// an mmapped range. If a parent allocator is given to DS_TLSFInit, new regions are also requested from it whenever an
+// allocation doesn't fit; for strictly bounded latency, make the first region large enough that this never happens.
+//
+// A pointer to a DS_TLSF can be cast to DS_Allocator* to allocate data structures from it.
+
+#define DS_TLSF_ALIGNMENT 16 // Every allocation is aligned to at least this
+#define DS_TLSF_SL_LOG2 4    // log2 of the number of second-level lists per first-level size class
+#define DS_TLSF_SL_COUNT (1 << DS_TLSF_SL_LOG2)
+#define DS_TLSF_FL_SHIFT (DS_TLSF_SL_LOG2 + 4) // Sizes below 1 << DS_TLSF_FL_SHIFT all go into the first size class
+#define DS_TLSF_FL_MAX 38    // Largest block size is 1 << DS_TLSF_FL_MAX
+#define DS_TLSF_FL_COUNT (DS_TLSF_FL_MAX - DS_TLSF_FL_SHIFT + 1)
+
+#ifndef DS_TLSF_REGION_SIZE
+#define DS_TLSF_REGION_SIZE DS_MIB(1) // Default size of regions requested from the parent allocator
+#endif
+
+typedef struct DS_TLSFRegion {
+	struct DS_TLSFRegion* next;
+	size_t size;
+	bool owned; // allocated from the parent allocator
+} DS_TLSFRegion;
+
+typedef struct DS_TLSFStats {
+	size_t total_size;         // size of all regions, including headers
+	size_t used_size;          // bytes in allocated blocks
+	size_t free_size;          // bytes in free blocks
+	size_t largest_free_block;
+	size_t free_block_count;
+	size_t used_block_count;
+	float fragmentation;       // 1 - largest_free_block / free_size; 0 means all free memory is in one block
+} DS_TLSFStats;
+
+typedef struct DS_TLSF {
+	union {
+		DS_AllocatorBase base;
+		struct DS_Info* ds;
+	};
+	DS_Allocator* allocator; // may be NULL
+	size_t region_size;
+	DS_TLSFRegion* regions;
+	size_t used_size;
+	uint32_t fl_bitmap;
+	uint32_t sl_bitmap[DS_TLSF_FL_COUNT];
+	struct DS_TLSFBlock* free_blocks[DS_TLSF_FL_COUNT][DS_TLSF_SL_COUNT];
+} DS_TLSF;
+
+// `allocator` is the parent allocator that new regions are requested from, or NULL to only use regions added with
+// DS_TLSFAddRegion. In that case, `ds` is used for the allocator's DS_Info.
+DS_API void DS_TLSFInit(DS_TLSF* tlsf, size_t region_size, DS_Allocator* allocator, DS_Info* ds);
+DS_API void DS_TLSFDeinit(DS_TLSF* tlsf); // Frees the regions allocated from the parent allocator
+
+// Adds a region of memory for the allocator to use. The memory must stay valid until DS_TLSFDeinit.
+DS_API void DS_TLSFAddRegion(DS_TLSF* tlsf, void* memory, size_t size);
+
+// These return NULL when out of memory.
+DS_API void* DS_TLSFAlloc(DS_TLSF* tlsf, size_t size, size_t alignment);
+DS_API void* DS_TLSFRealloc(DS_TLSF* tlsf, void* ptr, size_t size, size_t alignment);
+DS_API void DS_TLSFFree(DS_TLSF* tlsf, void* ptr);
+
+// Walks every block, so this is O(n) in the number of blocks.
+DS_API DS_TLSFStats DS_TLSFGetStats(DS_TLSF* tlsf);
+
+// -- Slab allocator ---------------------------------
+//
+// DS_SlabAllocator is a thread-safe general-purpose allocator for workloads where many threads allocate small blocks at
+// once, e.g. growing dynamic arrays and string builders on worker threads. Sizes from 16 bytes up to
+// DS_SLAB_MAX_SIZE are rounded up to one of DS_SLAB_CLASS_COUNT size classes and carved out of DS_SLAB_SIZE slabs
+// allocated from the parent allocator. Larger or more strictly aligned allocations go directly to the parent allocator.
+//
+// Each thread keeps a cache of free blocks per size class, so the common case of allocating or freeing a small block
+// takes no lock and no atomic operation. When a thread's cache runs empty or overflows, a batch of blocks (a magazine)
+// is moved from or to the shared depot of that size class, which is guarded by a per-class spin lock. Blocks may be
+// freed on a different thread than the one that allocated them. Slab memory is only returned to the parent allocator
+// in DS_SlabAllocatorDeinit.
+//
+// A thread caches blocks for up to DS_SLAB_THREAD_CACHE_COUNT slab allocators at a time; for any further ones, it goes
+// through the depot lock on every call. Call DS_SlabAllocatorThreadFlush before a thread exits or stops using an
+// allocator, so that its cached blocks return to the depot and its cache slot can be reused.
+//
+// A pointer to a DS_SlabAllocator can be cast to DS_Allocator* to allocate data structures from it.
+
+#ifndef DS_SLAB_SIZE
+#define DS_SLAB_SIZE DS_KIB(64) // Must be a power of 2. Slabs are aligned to their size.
+#endif
+
+#ifndef DS_SLAB_THREAD_CACHE_COUNT
+#define DS_SLAB_THREAD_CACHE_COUNT 4
+#endif
+
+#ifndef DS_SLAB_MAGAZINE_BYTES
+#define DS_SLAB_MAGAZINE_BYTES DS_KIB(16) // Approximate number of bytes moved between a thread cache and the depot at once
+#endif
+
+#define DS_SLAB_ALIGNMENT 16 // Every allocation is aligned to at least this
+#define DS_SLAB_MAX_SIZE DS_KIB(32)
+#define DS_SLAB_CLASS_COUNT 40 // 16, 32, ..., 128, then four classes per power of 2 up to DS_SLAB_MAX_SIZE
+
+typedef struct DS_SlabDepot {
+	DS_SpinLock lock;
+	uint32_t count;
+	void* free_list;
+	char pad[DS_CACHE_LINE_SIZE - 2 * sizeof(uint32_t) - sizeof(void*)];
+} DS_SlabDepot;
+
+typedef struct DS_SlabAllocator {
+	union {
+		DS_AllocatorBase base;
+		struct DS_Info* ds;
+	};
+	DS_Allocator* allocator;
+	uint32_t id; // Distinguishes this allocator from an earlier one at the same address in the thread caches
+
+	// Since DS_API functions are static, every translation unit that includes the implementation has its own thread caches.
+	// All calls go through the caches of the translation unit that called DS_SlabAllocatorInit, so that an allocator
+	// used from several of them still has one cache per thread, and `id` only needs to be unique within that unit.
+	struct DS_SlabThreadCache* (*get_thread_caches)(void);
+	uint32_t class_size[DS_SLAB_CLASS_COUNT];
+	uint32_t magazine_size[DS_SLAB_CLASS_COUNT];
+	DS_SpinLock slabs_lock;
+	struct DS_SlabHeader* slabs;
+	DS_SlabDepot depots[DS_SLAB_CLASS_COUNT];
+} DS_SlabAllocator;
+
+DS_API void DS_SlabAllocatorInit(DS_SlabAllocator* slab, DS_Allocator* allocator);
+
+// Frees every slab. No other thread may use the allocator anymore, and every other thread that has used it must have
+// called DS_SlabAllocatorThreadFlush. Blocks that went to the parent allocator must be freed before this.
+DS_API void DS_SlabAllocatorDeinit(DS_SlabAllocator* slab);
+
+// Moves the calling thread's cached blocks back to the depot and releases its cache slot for this allocator.
+DS_API void DS_SlabAllocatorThreadFlush(DS_SlabAllocator* slab);
+
+DS_API void* DS_SlabAlloc(DS_SlabAllocator* slab, size_t size, size_t alignment);
+DS_API void* DS_SlabRealloc(DS_SlabAllocator* slab, void* ptr, size_t size, size_t alignment);
+DS_API void DS_SlabFree(DS_SlabAllocator* slab, void* ptr);
+
+// -- Tracking allocator -----------------------------
+//
+// DS_TrackingAllocator wraps another allocator and counts, per tag, the live and peak bytes, the allocation, resize
+// and free calls, and a histogram of allocation sizes. The tag is a per-thread string set with DS_TrackingSetTag, e.g.
+// "ui" or "glyphs", and must stay valid for the lifetime of the tracker. Each allocation remembers the tag it was made
+// under, so resizing or freeing it later is accounted to the same tag. Allocations made without a tag, or after
+// DS_TRACKING_MAX_TAGS tags are in use, go to the "(untagged)" tag. The tracker is thread-safe if its parent is.
+//
+// Tracking is compiled in only when DS_ALLOCATOR_TRACKING is defined. Otherwise, DS_TrackingAllocatorInit returns the
+// parent allocator as is and the other functions do nothing, so the calls can stay in place at no cost.
+//
+// To find which subsystem grew between two points in time, diff two snapshots. Live bytes left in a snapshot taken at
+// shutdown are leaks.
+//
+// e.g.
+//   DS_TrackingAllocator tracker;
+//   DS_Allocator* heap = DS_TrackingAllocatorInit(&tracker, mem.heap);
+//   const char* prev_tag = DS_TrackingSetTag("glyphs");
+//   ... allocate from heap ...
+//   DS_TrackingSetTag(prev_tag);
+//
+//   DS_TrackingSnapshot before, after, diff;
+//   DS_TrackingTakeSnapshot(&tracker, &before);
+//   ...
+//   DS_TrackingTakeSnapshot(&tracker, &after);
+//   DS_TrackingDiff(&before, &after, &diff);
+//   printf("%s", DS_TrackingDump(&diff, temp_arena, false));
+
+#ifdef DS_ALLOCATOR_TRACKING
+
+#ifndef DS_TRACKING_MAX_TAGS
+#define DS_TRACKING_MAX_TAGS 32
+#endif
+
+#define DS_TRACKING_HISTOGRAM_BUCKETS 16 // <= 16 bytes, <= 32 bytes, ..., <= 256 KiB, larger
+
+typedef struct DS_TrackingTagStats {
+	const char* name;
+	int64_t live_bytes;
+	int64_t peak_bytes;
+	int64_t alloc_count;
+	int64_t resize_count;
+	int64_t free_count;
+	int64_t size_histogram[DS_TRACKING_HISTOGRAM_BUCKETS]; // allocation count by size
+} DS_TrackingTagStats;
+
+// In a diff, every field holds the change from the first snapshot to the second.
+typedef struct DS_TrackingSnapshot {
+	int64_t live_bytes;
+	int64_t peak_bytes; // peak of the total, which may be lower than the sum of the per-tag peaks
+	int tag_count;
+	DS_TrackingTagStats tags[DS_TRACKING_MAX_TAGS]; // tags[0] is "(untagged)". Tags are only ever appended.
+} DS_TrackingSnapshot;
+
+typedef struct DS_TrackingAllocator {
+	union {
+		DS_AllocatorBase base;
+		struct DS_Info* ds;
+	};
+	DS_Allocator* allocator;
+	DS_SpinLock lock;
+	DS_TrackingSnapshot stats;
+} DS_TrackingAllocator;
+
+// Returns the tracker as a DS_Allocator*.
+DS_API DS_Allocator* DS_TrackingAllocatorInit(DS_TrackingAllocator* tracker, DS_Allocator* allocator);
+DS_API void DS_TrackingAllocatorDeinit(DS_TrackingAllocator* tracker);
+
+// Sets the calling thread's tag and returns the previous one, which may be NULL.
+DS_API const char* DS_TrackingSetTag(const char* tag);
+
+DS_API void DS_TrackingTakeSnapshot(DS_TrackingAllocator* tracker, DS_TrackingSnapshot* out);
+DS_API void DS_TrackingDiff(const DS_TrackingSnapshot* before, const DS_TrackingSnapshot* after, DS_TrackingSnapshot* out);
+
+// Returns a human-readable report with tags sorted by live bytes, or a JSON object if `json` is true, as a
+// null-terminated string allocated from `out`.
+DS_API char* DS_TrackingDump(const DS_TrackingSnapshot* snapshot, DS_Arena* out, bool json);
+
+#else
+
+typedef struct DS_TrackingAllocator { int unused; } DS_TrackingAllocator;
+typedef struct DS_TrackingSnapshot { int tag_count; } DS_TrackingSnapshot;
+
+static inline DS_Allocator* DS_TrackingAllocatorInit(DS_TrackingAllocator* tracker, DS_Allocator* allocator) { return allocator; }
+static inline void DS_TrackingAllocatorDeinit(DS_TrackingAllocator* tracker) {}
+static inline const char* DS_TrackingSetTag(const char* tag) { return NULL; }
+static inline void DS_TrackingTakeSnapshot(DS_TrackingAllocator* tracker, DS_TrackingSnapshot* out) { out->tag_count = 0; }
+static inline void DS_TrackingDiff(const DS_TrackingSnapshot* before, const DS_TrackingSnapshot* after, DS_TrackingSnapshot* out) { out->tag_count = 0; }
+static inline char* DS_TrackingDump(const DS_TrackingSnapshot* snapshot, DS_Arena* out, bool json) { return (char*)""; }
+
+#endif
+
+// -- Memory allocation --------------------------------
 
 #define DS_MemAlloc(ALLOCATOR, SIZE)                               (ALLOCATOR)->base.allocator_proc(&(ALLOCATOR)->base,  NULL,          0, (SIZE), DS_DEFAULT_ALLOCATOR_PROC_ALIGNMENT)
 #define DS_MemResize(ALLOCATOR, PTR, OLD_SIZE, SIZE)               (ALLOCATOR)->base.allocator_proc(&(ALLOCATOR)->base, (PTR), (OLD_SIZE), (SIZE), DS_DEFAULT_ALLOCATOR_PROC_ALIGNMENT)
@@ -900,20 +2159,89 @@ DS_API void DS_ArrPopRaw(DS_DynArrayRaw* array, DS_OUT void* out_elem, int elem_
 	DS_ProfExit();
 }
 
-static inline void DS_MapInitRaw(DS_MapRaw* map, DS_Allocator* allocator) {
+static inline void DS_MapInitRaw(DS_MapRaw* map, DS_Allocator* allocator, DS_MapFlags flags) {
+	DS_ASSERT(!((flags & DS_MapFlag_FastClear) && (flags & DS_MapFlag_Groups)));
+	DS_ASSERT(flags <= 0xFF);
 	DS_MapRaw result = {allocator};
+	result.flags = (uint8_t)flags;
+	result.generation = 1;
 	*map = result;
 }
 
+// Returns the smallest capacity that can hold `count` keys without growing.
+static inline int DS_MapCapacityFor(DS_MapFlags flags, int count) {
+	bool groups = (flags & DS_MapFlag_Groups) != 0;
+	int capacity = groups ? DS_MAP_GROUP_SIZE : 8;
+	while (groups ? 8 * count > 7 * capacity : 100 * count > 70 * capacity) capacity *= 2;
+	return capacity;
+}
+
+static void DS_MapTableAlloc(DS_MapRaw* table, int capacity, int elem_size);
+
+static inline bool DS_MapIsMigrating(const DS_MapRaw* map) { return map->modes && map->modes->old_data; }
+
+static inline DS_MapModeState* DS_MapGetModeState(DS_MapRaw* map) {
+	if (map->modes == NULL) {
+		map->modes = (DS_MapModeState*)DS_MemAlloc(map->allocator, sizeof(DS_MapModeState));
+		memset(map->modes, 0, sizeof(DS_MapModeState));
+	}
+	return map->modes;
+}
+
 static inline void DS_MapClearRaw(DS_MapRaw* map, int elem_size) {
-	memset(map->data, 0, map->capacity * elem_size);
+	int count_before_clear = map->count;
+	if (DS_MapIsMigrating(map)) {
+		DS_MemFree(map->allocator, map->modes->old_data);
+		map->modes->old_data = NULL;
+		map->modes->old_capacity = 0;
+		map->modes->migrate_index = 0;
+	}
 	map->count = 0;
+	map->tombstones = 0;
+
+	if ((map->flags & DS_MapFlag_ShrinkOnClear) && map->capacity > 0) {
+		DS_MapModeState* modes = DS_MapGetModeState(map);
+		if (4 * DS_MapCapacityFor(map->flags, count_before_clear) <= map->capacity) {
+			if (count_before_clear > modes->small_clears_peak) modes->small_clears_peak = count_before_clear;
+
+			if (++modes->small_clears >= DS_MAP_SHRINK_AFTER_CLEARS) {
+				// Leave room for twice the biggest recent count, so that the map doesn't immediately grow back.
+				int new_capacity = 2 * DS_MapCapacityFor(map->flags, modes->small_clears_peak);
+				DS_DebugFillGarbage(map->data, DS_MapAllocSize(map, elem_size));
+				DS_MemFree(map->allocator, map->data);
+				DS_MapTableAlloc(map, new_capacity, elem_size);
+				map->generation = 1;
+				modes->small_clears = 0;
+				modes->small_clears_peak = 0;
+				return;
+			}
+		}
+		else {
+			modes->small_clears = 0;
+			modes->small_clears_peak = 0;
+		}
+	}
+
+	if (map->flags & DS_MapFlag_Groups) {
+		memset(DS_MapCtrl(map, elem_size), DS_MAP_CTRL_EMPTY, map->capacity);
+	}
+	else if ((map->flags & DS_MapFlag_FastClear) && map->generation < 255) {
+		map->generation++;
+	}
+	else {
+		memset(map->data, 0, map->capacity * elem_size);
+		map->generation = 1;
+	}
 }
 
 static inline void DS_MapDeinitRaw(DS_MapRaw* map, int elem_size) {
 	DS_ProfEnter();
-	DS_DebugFillGarbage(map->data, map->capacity * elem_size);
+	DS_DebugFillGarbage(map->data, DS_MapAllocSize(map, elem_size));
 	DS_MemFree(map->allocator, map->data);
+	if (map->modes) {
+		if (map->modes->old_data) DS_MemFree(map->allocator, map->modes->old_data);
+		DS_MemFree(map->allocator, map->modes);
+	}
 	DS_MapRaw empty = {0};
 	*map = empty;
 	DS_ProfExit();
@@ -1016,179 +2344,713 @@ DS_API uint32_t DS_MurmurHash3(const void* key, size_t size, uint32_t seed) {
 	return h1;
 }
 
-static inline void* DS_MapFindPtrRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	if (map->capacity == 0) return NULL;
-	DS_ProfEnter();
+// -- Fast hash --
+//
+// Keys of up to 16 bytes are read with at most four overlapping loads and hashed without any loops, and keys of up to
+// DS_FAST_HASH_LONG_SIZE bytes are hashed 48 bytes per iteration with three independent 64x64->128 bit multiplies,
+// both in the style of wyhash (https://github.com/wangyi-fudan/wyhash). Longer keys are accumulated 64 bytes per
+// iteration into eight 64-bit lanes using only 32x32->64 bit multiplies in the style of XXH3
+// (https://github.com/Cyan4973/xxHash), which maps directly onto SSE2. The SSE2 and scalar lane paths give identical results.
+//
+// With a native 128-bit multiply (x64, ARM64), the wyhash loop is faster than the SSE2 lane path at every key size, so the
+// lane path is only used by default when the multiply has to be emulated, e.g. in 32-bit builds. This means that hash
+// values may differ between targets, so they shouldn't be persisted.
 
-	// TODO: it'd be nice to use an integer hash function for small keys... just not sure how to implement that in an ergonomic way.
-	// Maybe just ask for the hash?
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
-	uint32_t hash = DS_MurmurHash3(key, K_size, 989898);
-	if (hash == 0) hash = 1;
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))) || defined(__SIZEOF_INT128__)
+#define DS_MUM_NATIVE
+#endif
 
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t index = hash & mask;
+#ifndef DS_FAST_HASH_LONG_SIZE
+#ifdef DS_MUM_NATIVE
+#define DS_FAST_HASH_LONG_SIZE SIZE_MAX
+#else
+#define DS_FAST_HASH_LONG_SIZE 256
+#endif
+#endif
 
-	void* found = NULL;
-	for (;;) {
-		char* elem = (char*)map->data + index * elem_size;
-		uint32_t elem_hash = *(uint32_t*)elem;
-		if (elem_hash == 0) break;
+static const uint64_t DS_fast_hash_secret[24] = {
+	0x1ac046dda8e86e2aLLU, 0xbe2c3b00b1d348c8LLU, 0x9b1a66a95412ff75LLU, 0xc448c2b1f05f7e4cLLU,
+	0xc111ca6b8f6e73c4LLU, 0xb54861920d05b01dLLU, 0x8d61500f4a7bbe16LLU, 0x5e0c25471f89e02eLLU,
+	0x48105a3d28f0e221LLU, 0x2169f8846b637746LLU, 0x3d628782e0c0d863LLU, 0xa5ddb2216078aa40LLU,
+	0xc8119d17f0571101LLU, 0x98e2e2eb8f33280fLLU, 0x8cd1e28860679cc4LLU, 0x9dca6189c923aef3LLU,
+	0x9d8d3071ba4f04c4LLU, 0x5d395ada34220c26LLU, 0xe6de42a441a1e28eLLU, 0x308fbf68cc864f59LLU,
+	0x216a3c81332862f9LLU, 0xbaceca0a77f3132eLLU, 0xdf2a2215339ca69cLLU, 0x3e4c11a103a5d859LLU,
+};
 
-		if (hash == elem_hash && memcmp(key, elem + key_offset, K_size) == 0) {
-			found = elem + val_offset;
-			break;
-		}
+static inline uint64_t DS_Read64(const uint8_t* p) { uint64_t x; memcpy(&x, p, 8); return x; }
+static inline uint64_t DS_Read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; }
+
+// 64x64->128 bit multiply, returning the low and high halves in *a and *b.
+static inline void DS_Mum(uint64_t* a, uint64_t* b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	*a = _umul128(*a, *b, b);
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+	uint64_t lo = *a * *b;
+	*b = __umulh(*a, *b);
+	*a = lo;
+#elif defined(DS_MUM_NATIVE)
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
 
-		index = (index + 1) & mask;
-	}
+static inline uint64_t DS_MumMix(uint64_t a, uint64_t b) { DS_Mum(&a, &b); return a ^ b; }
 
-	DS_ProfExit();
-	return found;
-}
+#define DS_FAST_HASH_PRIME32 0x9E3779B1U
 
-static inline bool DS_MapFindRaw(DS_MapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	DS_ProfEnter();
-	void* ptr = DS_MapFindPtrRaw(map, key, K_size, V_size, elem_size, key_offset, val_offset);
-	if (ptr) {
-		if (out_val) memcpy(out_val, ptr, V_size);
+#if defined(DS_MAP_SSE2)
+typedef __m128i DS_FastHashLanes[4];
+
+static inline void DS_FastHashAccumulate(__m128i* acc, const uint8_t* p, const uint64_t* secret) {
+	for (int i = 0; i < 4; i++) {
+		__m128i data = _mm_loadu_si128((const __m128i*)(p + 16*i));
+		__m128i data_key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(secret + 2*i)));
+		__m128i product = _mm_mul_epu32(data_key, _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+		__m128i data_swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, data_swapped));
 	}
-	DS_ProfExit();
-	return ptr != NULL;
 }
 
-static inline bool DS_MapGetOrAddRaw(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	uint32_t hash = DS_MurmurHash3((char*)key, K_size, 989898);
-	if (hash == 0) hash = 1;
-	bool result = DS_MapGetOrAddRawEx(map, key, out_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, hash);
-	return result;
+static inline void DS_FastHashScramble(__m128i* acc) {
+	const uint64_t* secret = DS_fast_hash_secret + 16;
+	__m128i prime = _mm_set1_epi32((int)DS_FAST_HASH_PRIME32);
+	for (int i = 0; i < 4; i++) {
+		__m128i x = acc[i];
+		x = _mm_xor_si128(x, _mm_srli_epi64(x, 47));
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i*)(secret + 2*i)));
+		__m128i lo = _mm_mul_epu32(x, prime);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+		acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
 }
+#else
+typedef uint64_t DS_FastHashLanes[8];
 
-static bool DS_MapGetOrAddRawEx(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash) {
-	DS_ProfEnter();
-	DS_ASSERT(map->allocator != NULL); // Have you called DS_MapInit?
-
-	if (100 * (map->count + 1) > 70 * map->capacity) {
-		// Grow the map
-
-		char* old_data = (char*)map->data;
-		int old_capacity = map->capacity;
-
-		map->capacity = old_capacity == 0 ? 8 : old_capacity * 2;
-		map->count = 0;
+static inline void DS_FastHashAccumulate(uint64_t* acc, const uint8_t* p, const uint64_t* secret) {
+	for (int i = 0; i < 8; i++) {
+		uint64_t data_key = DS_Read64(p + 8*i) ^ secret[i];
+		acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32) + DS_Read64(p + 8*(i ^ 1));
+	}
+}
 
-		void* new_data = DS_MemAlloc(map->allocator, map->capacity * elem_size);
+static inline void DS_FastHashScramble(uint64_t* acc) {
+	const uint64_t* secret = DS_fast_hash_secret + 16;
+	for (int i = 0; i < 8; i++) {
+		uint64_t x = acc[i];
+		acc[i] = (x ^ (x >> 47) ^ secret[i]) * DS_FAST_HASH_PRIME32;
+	}
+}
+#endif
 
-		memcpy(&map->data, &new_data, sizeof(void*));
-		memset(map->data, 0, map->capacity * elem_size); // set hash values to 0
+// Accumulates 64-byte stripes into eight 64-bit lanes. Stripe n of each 1 KB block uses the secret starting from word n,
+// and each block ends with a scramble of the lanes.
+static uint64_t DS_FastHashLong(const uint8_t* p, size_t size, uint64_t seed) {
+	DS_FastHashLanes lanes;
+	uint64_t acc[8];
+	for (int i = 0; i < 8; i++) acc[i] = DS_fast_hash_secret[i] ^ seed;
+	memcpy(lanes, acc, sizeof(acc));
+
+	size_t stripes = (size - 1) / 64;
+	size_t n = 0;
+	for (; n + 16 <= stripes; n += 16) {
+		for (int j = 0; j < 16; j++) {
+			DS_FastHashAccumulate(lanes, p + (n + j) * 64, DS_fast_hash_secret + j);
+		}
+		DS_FastHashScramble(lanes);
+	}
+	for (; n < stripes; n++) {
+		DS_FastHashAccumulate(lanes, p + n * 64, DS_fast_hash_secret + (n & 15));
+	}
+	DS_FastHashAccumulate(lanes, p + size - 64, DS_fast_hash_secret + 7); // last 64 bytes, which may overlap the previous stripe
 
-		for (int i = 0; i < old_capacity; i++) {
-			char* elem = old_data + elem_size * i;
-			uint32_t elem_hash = *(uint32_t*)elem;
-			void* elem_key = elem + key_offset;
-			void* elem_val = elem + val_offset;
+	memcpy(acc, lanes, sizeof(acc));
+	uint64_t result = size * 0x9E3779B185EBCA87LLU;
+	for (int i = 0; i < 4; i++) {
+		result += DS_MumMix(acc[2*i] ^ DS_fast_hash_secret[8 + 2*i], acc[2*i + 1] ^ DS_fast_hash_secret[9 + 2*i]);
+	}
+	result ^= result >> 37;
+	result *= 0x165667919E3779F9LLU;
+	result ^= result >> 32;
+	return result;
+}
 
-			if (elem_hash != 0) {
-				void* new_val_ptr;
-				DS_MapGetOrAddRawEx(map, elem_key, &new_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, elem_hash);
-				memcpy(new_val_ptr, elem_val, V_size);
-			}
+// Hashes a key of up to DS_FAST_HASH_LONG_SIZE bytes. `mixed_seed` is the seed after DS_FastHashMixSeed, so that callers
+// with a fixed seed can pass a precomputed one.
+static inline uint64_t DS_FastHashShort(const uint8_t* p, size_t size, uint64_t mixed_seed) {
+	const uint64_t* s = DS_fast_hash_secret;
+	uint64_t seed = mixed_seed;
+	uint64_t a, b;
+	if (size <= 16) {
+		if (size >= 4) {
+			size_t mid = (size >> 3) << 2;
+			a = (DS_Read32(p) << 32) | DS_Read32(p + mid);
+			b = (DS_Read32(p + size - 4) << 32) | DS_Read32(p + size - 4 - mid);
 		}
-
-		DS_DebugFillGarbage(old_data, old_capacity * elem_size);
-		DS_MemFree(map->allocator, old_data);
+		else if (size > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		size_t i = size;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = DS_MumMix(DS_Read64(p) ^ s[1], DS_Read64(p + 8) ^ seed);
+				see1 = DS_MumMix(DS_Read64(p + 16) ^ s[2], DS_Read64(p + 24) ^ see1);
+				see2 = DS_MumMix(DS_Read64(p + 32) ^ s[3], DS_Read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = DS_MumMix(DS_Read64(p) ^ s[1], DS_Read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = DS_Read64(p + i - 16);
+		b = DS_Read64(p + i - 8);
 	}
 
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t idx = hash & mask;
+	a ^= s[1];
+	b ^= seed;
+	DS_Mum(&a, &b);
+	return DS_MumMix(a ^ s[0] ^ size, b ^ s[1]);
+}
 
-	bool added_new = false;
+static inline uint64_t DS_FastHashMixSeed(uint64_t seed) {
+	return seed ^ DS_MumMix(seed ^ DS_fast_hash_secret[0], DS_fast_hash_secret[1]);
+}
 
-	for (;;) {
-		char* elem_base = (char*)map->data + idx * elem_size;
+DS_API uint64_t DS_FastHash64(const void* key, size_t size, uint64_t seed) {
+	DS_ProfEnter();
+	uint64_t result = size > DS_FAST_HASH_LONG_SIZE ?
+		DS_FastHashLong((const uint8_t*)key, size, seed) :
+		DS_FastHashShort((const uint8_t*)key, size, DS_FastHashMixSeed(seed));
+	DS_ProfExit();
+	return result;
+}
 
-		uint32_t* elem_hash = (uint32_t*)elem_base;
-		char* elem_key = elem_base + key_offset;
-		char* elem_val = elem_base + val_offset;
+DS_API uint32_t DS_MapHashDefault(const void* key, int size) {
+#if DS_MAP_DEFAULT_HASH == DS_MAP_HASH_MURMUR3
+	return DS_MurmurHash3(key, size, 989898);
+#else
+	// Integer-sized keys get the much cheaper DS_MapHashInt mixer. Anything else is DS_FastHash64(key, size, 989898),
+	// with the seed mix precomputed, as compilers can't always fold the 128-bit multiply in it.
+	if (size == 4 || size == 8) return DS_MapHashInt(key, size);
+	if ((size_t)size > DS_FAST_HASH_LONG_SIZE) return (uint32_t)DS_FastHashLong((const uint8_t*)key, size, 989898);
+	return (uint32_t)DS_FastHashShort((const uint8_t*)key, size, 0x40d0c08e5603be42LLU); // DS_FastHashMixSeed(989898)
+#endif
+}
 
-		if (*elem_hash == 0) {
-			// We found an empty slot
-			memcpy(elem_key, key, K_size);
-			*elem_hash = hash;
+DS_API uint32_t DS_MapHashInt(const void* key, int size) {
+	uint64_t x;
+	if (size == 8) {
+		memcpy(&x, key, 8);
+	}
+	else if (size == 4) {
+		uint32_t x32;
+		memcpy(&x32, key, 4);
+		x = x32;
+	}
+	else {
+		return DS_MapHashDefault(key, size);
+	}
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93LLU;
+	x ^= x >> 32;
+	return (uint32_t)x;
+}
 
-			if (out_val_ptr) *out_val_ptr = elem_val;
-			map->count++;
-			added_new = true;
-			break;
-		}
+// -- Map tables -------------------------------------------------
+//
+// The functions in this section operate on a single table, and are used for both the main table and the old table
+// during an incremental migration (DS_MapFlag_IncrementalGrow). The old table is viewed through a DS_MapRaw returned by DS_MapOldTable.
 
-		if (hash == *elem_hash && memcmp(key, elem_key, K_size) == 0) {
-			// This key already exists
-			if (out_val_ptr) *out_val_ptr = elem_val;
-			break;
-		}
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int DS_CountTrailingZeros32(uint32_t x) { unsigned long i; _BitScanForward(&i, x); return (int)i; }
+#else
+#define DS_CountTrailingZeros32(x) __builtin_ctz(x)
+#endif
 
-		idx = (idx + 1) & mask;
+// Returns a 16-bit mask of the slots in the group whose control byte equals `ctrl_byte`.
+static inline uint32_t DS_MapGroupMatch(const uint8_t* group, uint8_t ctrl_byte) {
+#if defined(DS_MAP_SSE2)
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)ctrl_byte)));
+#elif defined(DS_MAP_NEON)
+	static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t cmp = vandq_u8(vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl_byte)), vld1q_u8(bits));
+	return (uint32_t)vaddv_u8(vget_low_u8(cmp)) | ((uint32_t)vaddv_u8(vget_high_u8(cmp)) << 8);
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < DS_MAP_GROUP_SIZE; i++) {
+		if (group[i] == ctrl_byte) mask |= 1u << i;
 	}
-
-	DS_ProfExit();
-	return added_new;
+	return mask;
+#endif
 }
 
-static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
-	if (map->capacity == 0) return false;
-	DS_ProfEnter();
-
-	uint32_t hash = DS_MurmurHash3((char*)key, K_size, 989898);
-	if (hash == 0) hash = 1;
-
-	uint32_t mask = (uint32_t)map->capacity - 1;
-	uint32_t index = hash & mask;
+// Returns a 16-bit mask of the slots in the group that are either empty or deleted, i.e. have the top bit set.
+static inline uint32_t DS_MapGroupMatchEmptyOrDeleted(const uint8_t* group) {
+#if defined(DS_MAP_SSE2)
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#elif defined(DS_MAP_NEON)
+	static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t cmp = vandq_u8(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(group)), vdupq_n_s8(0)), vld1q_u8(bits));
+	return (uint32_t)vaddv_u8(vget_low_u8(cmp)) | ((uint32_t)vaddv_u8(vget_high_u8(cmp)) << 8);
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < DS_MAP_GROUP_SIZE; i++) {
+		if (group[i] & 0x80) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
 
-	bool ok = true;
+#define DS_MapGroupH2(HASH) (uint8_t)((HASH) >> 25)
 
-	char temp[DS_MAX_ELEM_SIZE];
-	DS_ASSERT(DS_MAX_ELEM_SIZE >= elem_size);
+static inline DS_MapRaw DS_MapOldTable(DS_MapRaw* map) {
+	DS_MapRaw old = {map->allocator};
+	memcpy(&old.data, &map->modes->old_data, sizeof(void*));
+	old.capacity = map->modes->old_capacity;
+	old.flags = map->flags;
+	old.generation = map->generation;
+	return old;
+}
 
-	for (;;) {
-		char* elem_base = (char*)map->data + index * elem_size;
-		uint32_t elem_hash = *(uint32_t*)elem_base;
+static inline bool DS_MapSlotIsLive(const DS_MapRaw* table, const uint8_t* ctrl, int i, int elem_size) {
+	if (ctrl) return (ctrl[i] & 0x80) == 0;
+	return DS_MapHashIsLive(table, *(uint32_t*)((char*)table->data + i * elem_size));
+}
 
-		if (elem_hash == 0) {
-			// Empty slot, the key does not exist in the map
-			ok = false;
-			break;
+// Groups are aligned to DS_MAP_GROUP_SIZE and probed triangularly, which visits every group exactly once when the
+// group count is a power of two.
+static inline char* DS_MapGroupFind(DS_MapRaw* table, const void* key, uint32_t hash, int K_size, int elem_size, int key_offset) {
+	uint8_t* ctrl = DS_MapCtrl(table, elem_size);
+	uint32_t mask = (uint32_t)table->capacity - 1;
+	uint32_t pos = hash & mask & ~(DS_MAP_GROUP_SIZE - 1);
+	uint8_t h2 = DS_MapGroupH2(hash);
+
+	for (uint32_t step = DS_MAP_GROUP_SIZE;; step += DS_MAP_GROUP_SIZE) {
+		for (uint32_t match = DS_MapGroupMatch(ctrl + pos, h2); match; match &= match - 1) {
+			char* elem = (char*)table->data + (pos + DS_CountTrailingZeros32(match)) * elem_size;
+			if (*(uint32_t*)elem == hash && memcmp(key, elem + key_offset, K_size) == 0) {
+				return elem;
+			}
 		}
+		if (DS_MapGroupMatch(ctrl + pos, DS_MAP_CTRL_EMPTY)) return NULL;
+		pos = (pos + step) & mask;
+	}
+}
 
-		if (hash == elem_hash && memcmp(key, elem_base + key_offset, K_size) == 0) {
-			// Remove element
-			memset(elem_base, 0, elem_size);
-			map->count--;
-
-			// backwards-shift deletion.
-			// First remove all elements directly after this element from the map, then add them back to the map, starting from the first one to the right.
-			for (;;) {
-				index = (index + 1) & mask;
-
-				char* shifting_elem_base = (char*)map->data + index * elem_size;
-				uint32_t shifting_elem_hash = *(uint32_t*)shifting_elem_base;
-				if (shifting_elem_hash == 0) break;
+// Returns the index of the first empty or deleted slot along the probe sequence of `hash`.
+static inline uint32_t DS_MapGroupFindFreeSlot(DS_MapRaw* table, uint8_t* ctrl, uint32_t hash) {
+	uint32_t mask = (uint32_t)table->capacity - 1;
+	uint32_t pos = hash & mask & ~(DS_MAP_GROUP_SIZE - 1);
+	for (uint32_t step = DS_MAP_GROUP_SIZE;; step += DS_MAP_GROUP_SIZE) {
+		uint32_t free_mask = DS_MapGroupMatchEmptyOrDeleted(ctrl + pos);
+		if (free_mask) return pos + DS_CountTrailingZeros32(free_mask);
+		pos = (pos + step) & mask;
+	}
+}
 
-				memcpy(temp, shifting_elem_base, elem_size);
-				memset(shifting_elem_base, 0, elem_size);
-				map->count--;
+// * Returns the address of the element if the key was found, otherwise NULL.
+static inline char* DS_MapTableFind(DS_MapRaw* table, const void* key, uint32_t hash, int K_size, int elem_size, int key_offset) {
+	if (table->flags & DS_MapFlag_Groups) {
+		return DS_MapGroupFind(table, key, hash, K_size, elem_size, key_offset);
+	}
 
-				void* new_val_ptr;
-				DS_MapGetOrAddRawEx(map, temp + key_offset, &new_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, shifting_elem_hash);
-				memcpy(new_val_ptr, temp + val_offset, V_size);
-			}
+	uint32_t mask = (uint32_t)table->capacity - 1;
+	uint32_t index = hash & mask;
+	for (;;) {
+		char* elem = (char*)table->data + index * elem_size;
+		uint32_t elem_hash = *(uint32_t*)elem;
+		if (DS_MapHashEndsProbe(table, elem_hash)) return NULL;
 
-			break;
+		if (hash == elem_hash && memcmp(key, elem + key_offset, K_size) == 0) {
+			return elem;
 		}
 
 		index = (index + 1) & mask;
 	}
+}
 
+// Puts an element into a free slot of a table. The key must not already exist in the table and the table must have room for it.
+// * If `elem` is NULL, the slot is zero-initialized with only the hash filled in.
+// * Returns the address of the slot.
+static char* DS_MapTablePlace(DS_MapRaw* table, DS_OUT const void* elem, uint32_t hash, int elem_size) {
+	uint32_t slot;
+	if (table->flags & DS_MapFlag_Groups) {
+		uint8_t* ctrl = DS_MapCtrl(table, elem_size);
+		slot = DS_MapGroupFindFreeSlot(table, ctrl, hash);
+		if (ctrl[slot] == DS_MAP_CTRL_DELETED) table->tombstones--;
+		ctrl[slot] = DS_MapGroupH2(hash);
+	}
+	else {
+		uint32_t mask = (uint32_t)table->capacity - 1;
+		slot = hash & mask;
+		while (DS_MapHashIsLive(table, *(uint32_t*)((char*)table->data + slot * elem_size))) {
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	char* dst = (char*)table->data + slot * elem_size;
+	if (elem) {
+		memcpy(dst, elem, elem_size);
+	}
+	else {
+		memset(dst, 0, elem_size);
+		*(uint32_t*)dst = hash;
+	}
+	return dst;
+}
+
+// Marks a slot as deleted without moving any other elements.
+static inline void DS_MapTableKill(DS_MapRaw* table, char* elem, int elem_size) {
+	if (table->flags & DS_MapFlag_Groups) {
+		DS_MapCtrl(table, elem_size)[(elem - (char*)table->data) / elem_size] = DS_MAP_CTRL_DELETED;
+	}
+	else {
+		*(uint32_t*)elem = DS_MAP_TOMBSTONE_HASH;
+	}
+}
+
+static void DS_MapTableRemove(DS_MapRaw* table, char* elem, int elem_size) {
+	uint32_t mask = (uint32_t)table->capacity - 1;
+	uint32_t index = (uint32_t)((elem - (char*)table->data) / elem_size);
+
+	if (table->flags & DS_MapFlag_Groups) {
+		uint8_t* ctrl = DS_MapCtrl(table, elem_size);
+
+		// A probe sequence stops at the first group with an empty slot. If this group already has one, then no probe
+		// sequence continues past it, so the slot can be marked empty rather than leaving a tombstone behind.
+		if (DS_MapGroupMatch(ctrl + (index & ~(DS_MAP_GROUP_SIZE - 1)), DS_MAP_CTRL_EMPTY)) {
+			ctrl[index] = DS_MAP_CTRL_EMPTY;
+		}
+		else {
+			ctrl[index] = DS_MAP_CTRL_DELETED;
+			table->tombstones++;
+		}
+		return;
+	}
+
+	memset(elem, 0, elem_size);
+
+	char temp[DS_MAX_ELEM_SIZE];
+	DS_ASSERT(DS_MAX_ELEM_SIZE >= elem_size);
+
+	// backwards-shift deletion.
+	// First remove all elements directly after this element from the map, then add them back to the map, starting from the first one to the right.
+	for (;;) {
+		index = (index + 1) & mask;
+
+		char* shifting_elem_base = (char*)table->data + index * elem_size;
+		uint32_t shifting_elem_hash = *(uint32_t*)shifting_elem_base;
+		if (!DS_MapHashIsLive(table, shifting_elem_hash)) break;
+
+		memcpy(temp, shifting_elem_base, elem_size);
+		memset(shifting_elem_base, 0, elem_size);
+		DS_MapTablePlace(table, temp, shifting_elem_hash, elem_size);
+	}
+}
+
+static void DS_MapTableAlloc(DS_MapRaw* table, int capacity, int elem_size) {
+	DS_ASSERT(!(table->flags & DS_MapFlag_FastClear) || capacity <= (1 << 24)); // See DS_MapFlag_FastClear
+	table->capacity = capacity;
+	table->tombstones = 0;
+	void* new_data = DS_MemAlloc(table->allocator, DS_MapAllocSize(table, elem_size));
+	memcpy(&table->data, &new_data, sizeof(void*));
+
+	if (table->flags & DS_MapFlag_Groups) {
+		memset(DS_MapCtrl(table, elem_size), DS_MAP_CTRL_EMPTY, capacity);
+	}
+	else {
+		memset(table->data, 0, capacity * elem_size); // set hash values to 0
+	}
+}
+
+// Moves up to `max_slots` slots from the old table into the main table, and frees the old table when it's done.
+static void DS_MapMigrateStep(DS_MapRaw* map, int max_slots, int elem_size) {
+	DS_ProfEnter();
+	DS_MapRaw old = DS_MapOldTable(map);
+	uint8_t* old_ctrl = old.flags & DS_MapFlag_Groups ? DS_MapCtrl(&old, elem_size) : NULL;
+
+	DS_MapModeState* modes = map->modes;
+	int end = max_slots < old.capacity - modes->migrate_index ? modes->migrate_index + max_slots : old.capacity;
+	for (int i = modes->migrate_index; i < end; i++) {
+		if (DS_MapSlotIsLive(&old, old_ctrl, i, elem_size)) {
+			char* elem = (char*)old.data + i * elem_size;
+			DS_MapTablePlace(map, elem, *(uint32_t*)elem, elem_size);
+			DS_MapTableKill(&old, elem, elem_size); // Lookups into the old table must no longer find this element
+		}
+	}
+	modes->migrate_index = end;
+
+	if (end == old.capacity) {
+		DS_DebugFillGarbage(old.data, DS_MapAllocSize(&old, elem_size));
+		DS_MemFree(map->allocator, old.data);
+		modes->old_data = NULL;
+		modes->old_capacity = 0;
+		modes->migrate_index = 0;
+	}
+	DS_ProfExit();
+}
+
+// Moves all elements into a new table of `new_capacity` slots at once. No incremental migration may be in progress.
+static void DS_MapRehash(DS_MapRaw* map, int new_capacity, int elem_size) {
+	DS_ProfEnter();
+	DS_ASSERT(!DS_MapIsMigrating(map));
+	bool groups = (map->flags & DS_MapFlag_Groups) != 0;
+
+	DS_MapRaw old = *map;
+	uint8_t* old_ctrl = groups && old.data ? DS_MapCtrl(&old, elem_size) : NULL;
+	DS_MapTableAlloc(map, new_capacity, elem_size);
+
+	for (int i = 0; i < old.capacity; i++) {
+		if (DS_MapSlotIsLive(&old, old_ctrl, i, elem_size)) {
+			char* elem = (char*)old.data + i * elem_size;
+			DS_MapTablePlace(map, elem, *(uint32_t*)elem, elem_size);
+		}
+	}
+
+	if (old.data) {
+		DS_DebugFillGarbage(old.data, DS_MapAllocSize(&old, elem_size));
+		DS_MemFree(map->allocator, old.data);
+	}
+	DS_ProfExit();
+}
+
+static void DS_MapGrow(DS_MapRaw* map, int elem_size) {
+	DS_ProfEnter();
+	bool groups = (map->flags & DS_MapFlag_Groups) != 0;
+
+	// In the group layout, if most of the used slots are tombstones, just clean up the table at the same capacity instead of growing it.
+	int new_capacity = map->capacity;
+	if (map->capacity == 0) new_capacity = groups ? DS_MAP_GROUP_SIZE : 8;
+	else if (!groups || map->tombstones < map->count) new_capacity *= 2;
+
+	if ((map->flags & DS_MapFlag_IncrementalGrow) && map->capacity > 0) {
+		// Every insert and remove moves DS_MAP_INCREMENTAL_GROW_STEP slots, so the previous migration is finished long
+		// before we need to grow again, unless the step is set very low. Finish it just in case.
+		if (DS_MapIsMigrating(map)) DS_MapMigrateStep(map, map->modes->old_capacity, elem_size);
+
+		DS_MapModeState* modes = DS_MapGetModeState(map);
+		modes->old_data = map->data;
+		modes->old_capacity = map->capacity;
+		modes->migrate_index = 0;
+		DS_MapTableAlloc(map, new_capacity, elem_size);
+	}
+	else {
+		DS_MapRehash(map, new_capacity, elem_size);
+	}
+	DS_ProfExit();
+}
+
+static inline void DS_MapReserveRaw(DS_MapRaw* map, int count, int elem_size) {
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_MapInit?
+	int new_capacity = DS_MapCapacityFor(map->flags, count);
+	if (new_capacity > map->capacity) {
+		if (DS_MapIsMigrating(map)) DS_MapMigrateStep(map, map->modes->old_capacity, elem_size);
+		DS_MapRehash(map, new_capacity, elem_size);
+	}
+}
+
+static inline void DS_MapShrinkToFitRaw(DS_MapRaw* map, int elem_size) {
+	if (DS_MapIsMigrating(map)) DS_MapMigrateStep(map, map->modes->old_capacity, elem_size);
+
+	if (map->count == 0) {
+		if (map->data) {
+			DS_DebugFillGarbage(map->data, DS_MapAllocSize(map, elem_size));
+			DS_MemFree(map->allocator, map->data);
+		}
+		map->data = NULL;
+		map->capacity = 0;
+		map->tombstones = 0;
+		map->generation = 1;
+		return;
+	}
+
+	int new_capacity = DS_MapCapacityFor(map->flags, map->count);
+	if (new_capacity < map->capacity) {
+		DS_MapRehash(map, new_capacity, elem_size);
+	}
+}
+
+// -------------------------------------------------------------
+
+static inline void* DS_MapFindPtrRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	if (map->capacity == 0) return NULL;
+	uint32_t hash = DS_MapHashRaw(map, key, K_size);
+	return DS_MapFindPtrRawEx(map, key, K_size, V_size, elem_size, key_offset, val_offset, hash);
+}
+
+static inline void* DS_MapFindPtrRawEx(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash) {
+	if (map->capacity == 0) return NULL;
+	DS_ProfEnter();
+	hash = DS_MapTagHash(map, DS_MapFixHash(hash));
+
+	char* found = DS_MapTableFind(map, key, hash, K_size, elem_size, key_offset);
+	if (found == NULL && DS_MapIsMigrating(map)) {
+		DS_MapRaw old = DS_MapOldTable(map);
+		found = DS_MapTableFind(&old, key, hash, K_size, elem_size, key_offset);
+	}
+
+	DS_ProfExit();
+	return found ? found + val_offset : NULL;
+}
+
+static inline bool DS_MapFindRaw(DS_MapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	DS_ProfEnter();
+	void* ptr = DS_MapFindPtrRaw(map, key, K_size, V_size, elem_size, key_offset, val_offset);
+	if (ptr) {
+		if (out_val) memcpy(out_val, ptr, V_size);
+	}
+	DS_ProfExit();
+	return ptr != NULL;
+}
+
+static inline bool DS_MapFindRawEx(DS_MapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash) {
+	DS_ProfEnter();
+	void* ptr = DS_MapFindPtrRawEx(map, key, K_size, V_size, elem_size, key_offset, val_offset, hash);
+	if (ptr) {
+		if (out_val) memcpy(out_val, ptr, V_size);
+	}
+	DS_ProfExit();
+	return ptr != NULL;
+}
+
+#ifndef DS_MAP_FIND_BATCH_SIZE
+#define DS_MAP_FIND_BATCH_SIZE 16
+#endif
+
+static void DS_MapFindNRaw(DS_MapRaw* map, const void* keys, int count, DS_OUT void** out_val_ptrs, DS_OUT bool* out_found, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	DS_ProfEnter();
+	uint32_t hashes[DS_MAP_FIND_BATCH_SIZE];
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	bool groups = (map->flags & DS_MapFlag_Groups) != 0;
+
+	for (int batch_start = 0; batch_start < count; batch_start += DS_MAP_FIND_BATCH_SIZE) {
+		int batch_count = count - batch_start < DS_MAP_FIND_BATCH_SIZE ? count - batch_start : DS_MAP_FIND_BATCH_SIZE;
+		const char* batch_keys = (const char*)keys + (size_t)batch_start * K_size;
+
+		if (map->capacity > 0) {
+			// Hash everything and issue the prefetches first, then probe.
+			for (int i = 0; i < batch_count; i++) {
+				uint32_t hash = DS_MapTagHash(map, DS_MapHashRaw(map, batch_keys + i * K_size, K_size));
+				hashes[i] = hash;
+				if (groups) {
+					uint32_t pos = hash & mask & ~(DS_MAP_GROUP_SIZE - 1);
+					DS_Prefetch(DS_MapCtrl(map, elem_size) + pos);
+					DS_Prefetch((char*)map->data + (size_t)pos * elem_size);
+				}
+				else {
+					DS_Prefetch((char*)map->data + (size_t)(hash & mask) * elem_size);
+				}
+			}
+		}
+
+		for (int i = 0; i < batch_count; i++) {
+			void* val_ptr = map->capacity > 0 ? DS_MapFindPtrRawEx(map, batch_keys + i * K_size, K_size, V_size, elem_size, key_offset, val_offset, hashes[i]) : NULL;
+			if (out_val_ptrs) out_val_ptrs[batch_start + i] = val_ptr;
+			if (out_found) out_found[batch_start + i] = val_ptr != NULL;
+		}
+	}
+	DS_ProfExit();
+}
+
+static inline bool DS_MapGetOrAddRaw(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	uint32_t hash = DS_MapHashRaw(map, key, K_size);
+	bool result = DS_MapGetOrAddRawEx(map, key, out_val_ptr, K_size, V_size, elem_size, key_offset, val_offset, hash);
+	return result;
+}
+
+static bool DS_MapGetOrAddRawEx(DS_MapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash) {
+	DS_ProfEnter();
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_MapInit?
+	hash = DS_MapTagHash(map, hash);
+
+	if (DS_MapIsMigrating(map)) DS_MapMigrateStep(map, DS_MAP_INCREMENTAL_GROW_STEP, elem_size);
+
+	char* elem = map->capacity > 0 ? DS_MapTableFind(map, key, hash, K_size, elem_size, key_offset) : NULL;
+	bool added_new = false;
+
+	if (elem == NULL && DS_MapIsMigrating(map)) {
+		DS_MapRaw old = DS_MapOldTable(map);
+		char* old_elem = DS_MapTableFind(&old, key, hash, K_size, elem_size, key_offset);
+		if (old_elem) {
+			// Move the element over now, so that the returned value pointer stays valid for the rest of the migration.
+			// The element count already includes it, so the main table is guaranteed to have room.
+			elem = DS_MapTablePlace(map, old_elem, hash, elem_size);
+			DS_MapTableKill(&old, old_elem, elem_size);
+		}
+	}
+
+	if (elem == NULL) {
+		bool needs_grow = map->flags & DS_MapFlag_Groups ?
+			8 * (map->count + map->tombstones + 1) > 7 * map->capacity :
+			100 * (map->count + 1) > 70 * map->capacity;
+		if (needs_grow) DS_MapGrow(map, elem_size);
+
+		elem = DS_MapTablePlace(map, NULL, hash, elem_size);
+		memcpy(elem + key_offset, key, K_size);
+		map->count++;
+		added_new = true;
+	}
+
+	if (out_val_ptr) *out_val_ptr = elem + val_offset;
+	DS_ProfExit();
+	return added_new;
+}
+
+static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	if (map->capacity == 0) return false;
+	uint32_t hash = DS_MapHashRaw(map, key, K_size);
+	return DS_MapRemoveRawEx(map, key, K_size, V_size, elem_size, key_offset, val_offset, hash);
+}
+
+static inline bool DS_MapRemoveRawEx(DS_MapRaw* map, const void* key, int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash) {
+	if (map->capacity == 0) return false;
+	DS_ProfEnter();
+	hash = DS_MapTagHash(map, DS_MapFixHash(hash));
+
+	if (DS_MapIsMigrating(map)) DS_MapMigrateStep(map, DS_MAP_INCREMENTAL_GROW_STEP, elem_size);
+
+	bool ok = false;
+	char* elem = DS_MapTableFind(map, key, hash, K_size, elem_size, key_offset);
+	if (elem) {
+		DS_MapTableRemove(map, elem, elem_size);
+		ok = true;
+	}
+	else if (DS_MapIsMigrating(map)) {
+		// Slots in the old table can't be shifted around during the migration, so leave a tombstone instead.
+		DS_MapRaw old = DS_MapOldTable(map);
+		elem = DS_MapTableFind(&old, key, hash, K_size, elem_size, key_offset);
+		if (elem) {
+			DS_MapTableKill(&old, elem, elem_size);
+			ok = true;
+		}
+	}
+
+	if (ok) map->count--;
 	DS_ProfExit();
 	return ok;
 }
@@ -1196,146 +3058,2577 @@ static inline bool DS_MapRemoveRaw(DS_MapRaw* map, const void* key, int K_size,
 static inline void DS_MapInitCloneRaw(DS_MapRaw* map, DS_MapRaw* src, DS_Allocator* allocator, int elem_size) {
 	*map = *src;
 	map->allocator = allocator;
-	*(void**)&map->data = DS_MemAlloc(allocator, src->capacity * elem_size);
-	memcpy(map->data, src->data, src->capacity * elem_size);
+	*(void**)&map->data = DS_MemAlloc(allocator, DS_MapAllocSize(src, elem_size));
+	memcpy(map->data, src->data, DS_MapAllocSize(src, elem_size));
+
+	if (src->modes) {
+		map->modes = (DS_MapModeState*)DS_MemAlloc(allocator, sizeof(DS_MapModeState));
+		*map->modes = *src->modes;
+		if (src->modes->old_data) {
+			DS_MapRaw old = DS_MapOldTable(src);
+			map->modes->old_data = DS_MemAlloc(allocator, DS_MapAllocSize(&old, elem_size));
+			memcpy(map->modes->old_data, src->modes->old_data, DS_MapAllocSize(&old, elem_size));
+		}
+	}
+}
+
+static inline bool DS_MapInsertRaw(DS_MapRaw* map, const void* key, DS_OUT void* val,
+	int K_size, int V_size, int elem_size, int key_offset, int val_offset)
+{
+	DS_ProfEnter();
+	void* val_ptr;
+	bool added = DS_MapGetOrAddRaw(map, key, &val_ptr, K_size, V_size, elem_size, key_offset, val_offset);
+	memcpy(val_ptr, val, V_size);
+	DS_ProfExit();
+	return added;
+}
+
+static inline bool DS_MapInsertRawEx(DS_MapRaw* map, const void* key, DS_OUT void* val,
+	int K_size, int V_size, int elem_size, int key_offset, int val_offset, uint32_t hash)
+{
+	DS_ProfEnter();
+	void* val_ptr;
+	bool added = DS_MapGetOrAddRawEx(map, key, &val_ptr, K_size, V_size, elem_size, key_offset, val_offset, DS_MapFixHash(hash));
+	memcpy(val_ptr, val, V_size);
+	DS_ProfExit();
+	return added;
+}
+
+// -- SoA map -------------------------------------------
+
+// The hash, key and value arrays are stored in a single allocation, each starting at a 16-byte aligned offset.
+static inline size_t DS_SoAMapKeysOffset(int capacity) { return DS_AlignUpPow2((size_t)capacity * sizeof(uint32_t), 16); }
+static inline size_t DS_SoAMapValuesOffset(int capacity, int K_size) { return DS_AlignUpPow2(DS_SoAMapKeysOffset(capacity) + (size_t)capacity * K_size, 16); }
+static inline size_t DS_SoAMapAllocSize(int capacity, int K_size, int V_size) { return DS_SoAMapValuesOffset(capacity, K_size) + (size_t)capacity * V_size; }
+
+static inline void DS_SoAMapInitRaw(DS_SoAMapRaw* map, DS_Allocator* allocator) {
+	DS_SoAMapRaw result = {allocator};
+	*map = result;
+}
+
+static inline void DS_SoAMapClearRaw(DS_SoAMapRaw* map) {
+	if (map->hashes) memset(map->hashes, 0, map->capacity * sizeof(uint32_t));
+	map->count = 0;
+}
+
+static void DS_SoAMapDeinitRaw(DS_SoAMapRaw* map, int K_size, int V_size) {
+	DS_ProfEnter();
+	if (map->hashes) {
+		DS_DebugFillGarbage(map->hashes, DS_SoAMapAllocSize(map->capacity, K_size, V_size));
+		DS_MemFree(map->allocator, map->hashes);
+	}
+	DS_SoAMapRaw empty = {0};
+	*map = empty;
+	DS_ProfExit();
+}
+
+// * Returns the slot index of the key, or -1 if it's not found.
+static inline int DS_SoAMapTableFind(DS_SoAMapRaw* map, const void* key, uint32_t hash, int K_size) {
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	for (uint32_t index = hash & mask;; index = (index + 1) & mask) {
+		uint32_t slot_hash = map->hashes[index];
+		if (slot_hash == 0) return -1;
+		if (slot_hash == hash && memcmp(key, map->keys + index * K_size, K_size) == 0) return (int)index;
+	}
+}
+
+// * Returns the index of a free slot for `hash`. The table must have room for it.
+static inline uint32_t DS_SoAMapTableFindFreeSlot(DS_SoAMapRaw* map, uint32_t hash) {
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	uint32_t index = hash & mask;
+	while (map->hashes[index] != 0) index = (index + 1) & mask;
+	return index;
+}
+
+static void DS_SoAMapGrow(DS_SoAMapRaw* map, int K_size, int V_size) {
+	DS_ProfEnter();
+	DS_SoAMapRaw old = *map;
+	map->capacity = old.capacity == 0 ? 8 : old.capacity * 2;
+
+	char* new_data = (char*)DS_MemAlloc(map->allocator, DS_SoAMapAllocSize(map->capacity, K_size, V_size));
+	map->hashes = (uint32_t*)new_data;
+	map->keys = new_data + DS_SoAMapKeysOffset(map->capacity);
+	map->values = new_data + DS_SoAMapValuesOffset(map->capacity, K_size);
+	memset(map->hashes, 0, map->capacity * sizeof(uint32_t));
+
+	for (int i = 0; i < old.capacity; i++) {
+		uint32_t hash = old.hashes[i];
+		if (hash == 0) continue;
+		uint32_t dst = DS_SoAMapTableFindFreeSlot(map, hash);
+		map->hashes[dst] = hash;
+		memcpy(map->keys + dst * K_size, old.keys + i * K_size, K_size);
+		memcpy(map->values + dst * V_size, old.values + i * V_size, V_size);
+	}
+
+	if (old.hashes) {
+		DS_DebugFillGarbage(old.hashes, DS_SoAMapAllocSize(old.capacity, K_size, V_size));
+		DS_MemFree(map->allocator, old.hashes);
+	}
+	DS_ProfExit();
+}
+
+static void* DS_SoAMapFindPtrRaw(DS_SoAMapRaw* map, const void* key, int K_size, int V_size) {
+	if (map->capacity == 0) return NULL;
+	DS_ProfEnter();
+	uint32_t hash = DS_MapFixHash(map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size));
+	int index = DS_SoAMapTableFind(map, key, hash, K_size);
+	DS_ProfExit();
+	return index >= 0 ? map->values + index * V_size : NULL;
+}
+
+static inline bool DS_SoAMapFindRaw(DS_SoAMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size) {
+	void* ptr = DS_SoAMapFindPtrRaw(map, key, K_size, V_size);
+	if (ptr && out_val) memcpy(out_val, ptr, V_size);
+	return ptr != NULL;
+}
+
+static bool DS_SoAMapGetOrAddRaw(DS_SoAMapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int V_size) {
+	DS_ProfEnter();
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_SoAMapInit?
+
+	uint32_t hash = DS_MapFixHash(map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size));
+	int index = map->capacity > 0 ? DS_SoAMapTableFind(map, key, hash, K_size) : -1;
+	bool added_new = false;
+
+	if (index < 0) {
+		if (100 * (map->count + 1) > 70 * map->capacity) DS_SoAMapGrow(map, K_size, V_size);
+
+		index = (int)DS_SoAMapTableFindFreeSlot(map, hash);
+		map->hashes[index] = hash;
+		memcpy(map->keys + index * K_size, key, K_size);
+		memset(map->values + index * V_size, 0, V_size);
+		map->count++;
+		added_new = true;
+	}
+
+	if (out_val_ptr) *out_val_ptr = map->values + index * V_size;
+	DS_ProfExit();
+	return added_new;
+}
+
+static inline bool DS_SoAMapInsertRaw(DS_SoAMapRaw* map, const void* key, const void* val, int K_size, int V_size) {
+	void* val_ptr;
+	bool added = DS_SoAMapGetOrAddRaw(map, key, &val_ptr, K_size, V_size);
+	memcpy(val_ptr, val, V_size);
+	return added;
+}
+
+static bool DS_SoAMapRemoveRaw(DS_SoAMapRaw* map, const void* key, int K_size, int V_size) {
+	if (map->capacity == 0) return false;
+	DS_ProfEnter();
+	uint32_t hash = DS_MapFixHash(map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size));
+	int index = DS_SoAMapTableFind(map, key, hash, K_size);
+	if (index >= 0) {
+		// backwards-shift deletion. Move each following element of the cluster into the hole if the hole lies between
+		// its home slot and its current slot, which doesn't need a temporary copy of the element like DS_MapTableRemove.
+		uint32_t mask = (uint32_t)map->capacity - 1;
+		uint32_t hole = (uint32_t)index;
+		for (uint32_t i = (hole + 1) & mask; map->hashes[i] != 0; i = (i + 1) & mask) {
+			uint32_t home = map->hashes[i] & mask;
+			if (((i - home) & mask) >= ((i - hole) & mask)) {
+				map->hashes[hole] = map->hashes[i];
+				memcpy(map->keys + hole * K_size, map->keys + i * K_size, K_size);
+				memcpy(map->values + hole * V_size, map->values + i * V_size, V_size);
+				hole = i;
+			}
+		}
+		map->hashes[hole] = 0;
+		map->count--;
+	}
+	DS_ProfExit();
+	return index >= 0;
+}
+
+// -- Ordered map -------------------------------------------
+//
+// Each slot of the index table packs the hash of the key into the low 32 bits and the entry index plus one into the
+// high 32 bits, so 0 means an empty slot. Keeping the hash in the slot means that growing the index table never needs to
+// touch the entries, and probing only looks at an entry when the hash matches.
+
+#define DS_OrderedMapSlot(HASH, INDEX) ((uint64_t)(HASH) | ((uint64_t)((INDEX) + 1) << 32))
+#define DS_OrderedMapSlotIndex(SLOT) ((int)((SLOT) >> 32) - 1)
+
+static inline uint32_t DS_OrderedMapHash(DS_OrderedMapRaw* map, const void* key, int K_size) {
+	return map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size);
+}
+
+static inline void DS_OrderedMapInitRaw(DS_OrderedMapRaw* map, DS_Allocator* allocator) {
+	DS_OrderedMapRaw result = {allocator};
+	*map = result;
+}
+
+static inline void DS_OrderedMapClearRaw(DS_OrderedMapRaw* map) {
+	if (map->slots) memset(map->slots, 0, map->slot_capacity * sizeof(uint64_t));
+	map->count = 0;
+}
+
+static void DS_OrderedMapDeinitRaw(DS_OrderedMapRaw* map, int elem_size) {
+	DS_ProfEnter();
+	if (map->slots) {
+		DS_DebugFillGarbage(map->slots, map->slot_capacity * sizeof(uint64_t));
+		DS_MemFree(map->allocator, map->slots);
+	}
+	DS_ArrDeinitRaw((DS_DynArrayRaw*)map, elem_size);
+	DS_OrderedMapRaw empty = {0};
+	*map = empty;
+	DS_ProfExit();
+}
+
+// * Returns the address of the slot pointing to the key, or NULL if it's not found.
+static inline uint64_t* DS_OrderedMapFindSlot(DS_OrderedMapRaw* map, const void* key, uint32_t hash, int K_size, int elem_size, int key_offset) {
+	uint32_t mask = (uint32_t)map->slot_capacity - 1;
+	for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+		uint64_t slot = map->slots[i];
+		if (slot == 0) return NULL;
+		if ((uint32_t)slot == hash) {
+			char* elem = (char*)map->data + DS_OrderedMapSlotIndex(slot) * elem_size;
+			if (memcmp(key, elem + key_offset, K_size) == 0) return &map->slots[i];
+		}
+	}
+}
+
+static inline void DS_OrderedMapPlaceSlot(DS_OrderedMapRaw* map, uint64_t slot) {
+	uint32_t mask = (uint32_t)map->slot_capacity - 1;
+	uint32_t i = (uint32_t)slot & mask;
+	while (map->slots[i] != 0) i = (i + 1) & mask;
+	map->slots[i] = slot;
+}
+
+static void DS_OrderedMapGrowSlots(DS_OrderedMapRaw* map) {
+	DS_ProfEnter();
+	uint64_t* old_slots = map->slots;
+	int old_slot_capacity = map->slot_capacity;
+
+	map->slot_capacity = old_slot_capacity == 0 ? 8 : old_slot_capacity * 2;
+	map->slots = (uint64_t*)DS_MemAlloc(map->allocator, map->slot_capacity * sizeof(uint64_t));
+	memset(map->slots, 0, map->slot_capacity * sizeof(uint64_t));
+
+	for (int i = 0; i < old_slot_capacity; i++) {
+		if (old_slots[i] != 0) DS_OrderedMapPlaceSlot(map, old_slots[i]);
+	}
+
+	if (old_slots) {
+		DS_DebugFillGarbage(old_slots, old_slot_capacity * sizeof(uint64_t));
+		DS_MemFree(map->allocator, old_slots);
+	}
+	DS_ProfExit();
+}
+
+static int DS_OrderedMapFindIndexRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset) {
+	if (map->count == 0) return -1;
+	DS_ProfEnter();
+	uint64_t* slot = DS_OrderedMapFindSlot(map, key, DS_OrderedMapHash(map, key, K_size), K_size, elem_size, key_offset);
+	DS_ProfExit();
+	return slot ? DS_OrderedMapSlotIndex(*slot) : -1;
+}
+
+static inline void* DS_OrderedMapFindPtrRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset, int val_offset) {
+	int index = DS_OrderedMapFindIndexRaw(map, key, K_size, elem_size, key_offset);
+	return index >= 0 ? (char*)map->data + index * elem_size + val_offset : NULL;
+}
+
+static inline bool DS_OrderedMapFindRaw(DS_OrderedMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	void* ptr = DS_OrderedMapFindPtrRaw(map, key, K_size, elem_size, key_offset, val_offset);
+	if (ptr && out_val) memcpy(out_val, ptr, V_size);
+	return ptr != NULL;
+}
+
+static bool DS_OrderedMapGetOrAddRaw(DS_OrderedMapRaw* map, const void* key, DS_OUT void** out_val_ptr, int K_size, int elem_size, int key_offset, int val_offset) {
+	DS_ProfEnter();
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_OrderedMapInit?
+
+	uint32_t hash = DS_OrderedMapHash(map, key, K_size);
+	uint64_t* slot = map->count > 0 ? DS_OrderedMapFindSlot(map, key, hash, K_size, elem_size, key_offset) : NULL;
+	int index;
+	bool added_new = false;
+
+	if (slot) {
+		index = DS_OrderedMapSlotIndex(*slot);
+	}
+	else {
+		if (100 * (map->count + 1) > 70 * map->slot_capacity) DS_OrderedMapGrowSlots(map);
+
+		index = map->count;
+		DS_ArrReserveRaw((DS_DynArrayRaw*)map, index + 1, elem_size);
+		char* elem = (char*)map->data + index * elem_size;
+		memset(elem, 0, elem_size);
+		memcpy(elem + key_offset, key, K_size);
+		map->count++;
+
+		DS_OrderedMapPlaceSlot(map, DS_OrderedMapSlot(hash, index));
+		added_new = true;
+	}
+
+	if (out_val_ptr) *out_val_ptr = (char*)map->data + index * elem_size + val_offset;
+	DS_ProfExit();
+	return added_new;
+}
+
+static inline bool DS_OrderedMapInsertRaw(DS_OrderedMapRaw* map, const void* key, const void* val, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	void* val_ptr;
+	bool added = DS_OrderedMapGetOrAddRaw(map, key, &val_ptr, K_size, elem_size, key_offset, val_offset);
+	memcpy(val_ptr, val, V_size);
+	return added;
+}
+
+static bool DS_OrderedMapRemoveRaw(DS_OrderedMapRaw* map, const void* key, int K_size, int elem_size, int key_offset) {
+	if (map->count == 0) return false;
+	DS_ProfEnter();
+
+	uint64_t* slot = DS_OrderedMapFindSlot(map, key, DS_OrderedMapHash(map, key, K_size), K_size, elem_size, key_offset);
+	if (slot) {
+		int index = DS_OrderedMapSlotIndex(*slot);
+		int last = map->count - 1;
+
+		// Remove the slot with backwards-shift deletion.
+		uint32_t mask = (uint32_t)map->slot_capacity - 1;
+		uint32_t hole = (uint32_t)(slot - map->slots);
+		for (uint32_t i = (hole + 1) & mask; map->slots[i] != 0; i = (i + 1) & mask) {
+			uint32_t home = (uint32_t)map->slots[i] & mask;
+			if (((i - home) & mask) >= ((i - hole) & mask)) {
+				map->slots[hole] = map->slots[i];
+				hole = i;
+			}
+		}
+		map->slots[hole] = 0;
+
+		// Move the last entry into the freed place and repoint its slot.
+		if (index != last) {
+			char* last_elem = (char*)map->data + last * elem_size;
+			uint64_t* last_slot = DS_OrderedMapFindSlot(map, last_elem + key_offset, DS_OrderedMapHash(map, last_elem + key_offset, K_size), K_size, elem_size, key_offset);
+			*last_slot = DS_OrderedMapSlot((uint32_t)*last_slot, index);
+			memcpy((char*)map->data + index * elem_size, last_elem, elem_size);
+		}
+		map->count--;
+	}
+
+	DS_ProfExit();
+	return slot != NULL;
+}
+
+// -- String map -------------------------------------------
+
+static inline uint32_t DS_StrMapHash(DS_StrMapRaw* map, const void* key_data, size_t key_size) {
+	uint32_t hash = map->hash_fn ? map->hash_fn(key_data, (int)key_size) : DS_MapHashDefault(key_data, (int)key_size);
+	return hash == 0 ? 1 : hash;
+}
+
+// * Returns the address of the element if the key was found, otherwise NULL.
+static inline char* DS_StrMapTableFind(DS_StrMapRaw* map, const void* key_data, uint32_t key_size, uint32_t hash, int elem_size) {
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	for (uint32_t index = hash & mask;; index = (index + 1) & mask) {
+		char* elem = (char*)map->data + index * elem_size;
+		DS_StrMapKey* elem_key = (DS_StrMapKey*)elem;
+		if (elem_key->hash == 0) return NULL;
+
+		// Only look at the key bytes if both the hash and the length match
+		if (elem_key->hash == hash && elem_key->size == key_size && memcmp(elem_key->data, key_data, key_size) == 0) {
+			return elem;
+		}
+	}
+}
+
+static char* DS_StrMapTablePlace(DS_StrMapRaw* map, const void* elem, uint32_t hash, int elem_size) {
+	uint32_t mask = (uint32_t)map->capacity - 1;
+	uint32_t index = hash & mask;
+	while (*(uint32_t*)((char*)map->data + index * elem_size) != 0) {
+		index = (index + 1) & mask;
+	}
+	char* dst = (char*)map->data + index * elem_size;
+	memcpy(dst, elem, elem_size);
+	return dst;
+}
+
+static void DS_StrMapGrow(DS_StrMapRaw* map, int elem_size) {
+	DS_ProfEnter();
+	DS_StrMapRaw old = *map;
+	map->capacity = old.capacity == 0 ? 8 : old.capacity * 2;
+	*(void**)&map->data = DS_MemAlloc(map->allocator, (size_t)map->capacity * elem_size);
+	memset(map->data, 0, (size_t)map->capacity * elem_size);
+
+	for (int i = 0; i < old.capacity; i++) {
+		char* elem = (char*)old.data + i * elem_size;
+		uint32_t hash = *(uint32_t*)elem;
+		if (hash != 0) DS_StrMapTablePlace(map, elem, hash, elem_size);
+	}
+
+	if (old.data) {
+		DS_DebugFillGarbage(old.data, (size_t)old.capacity * elem_size);
+		DS_MemFree(map->allocator, old.data);
+	}
+	DS_ProfExit();
+}
+
+static void DS_StrMapInitRaw(DS_StrMapRaw* map, DS_Allocator* allocator) {
+	memset(map, 0, sizeof(*map));
+	map->allocator = allocator;
+	DS_ArenaInit(&map->key_arena, DS_STR_MAP_KEY_ARENA_BLOCK_SIZE, allocator);
+}
+
+static void DS_StrMapDeinitRaw(DS_StrMapRaw* map, int elem_size) {
+	if (map->data) {
+		DS_DebugFillGarbage(map->data, (size_t)map->capacity * elem_size);
+		DS_MemFree(map->allocator, map->data);
+	}
+	DS_ArenaDeinit(&map->key_arena);
+	memset(map, 0, sizeof(*map));
+}
+
+static void DS_StrMapClearRaw(DS_StrMapRaw* map, int elem_size) {
+	if (map->data) memset(map->data, 0, (size_t)map->capacity * elem_size);
+	map->count = 0;
+	DS_ArenaReset(&map->key_arena);
+}
+
+static void* DS_StrMapFindPtrRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, int elem_size, int val_offset) {
+	if (map->count == 0) return NULL;
+	DS_ProfEnter();
+	uint32_t hash = DS_StrMapHash(map, key_data, key_size);
+	char* found = DS_StrMapTableFind(map, key_data, (uint32_t)key_size, hash, elem_size);
+	DS_ProfExit();
+	return found ? found + val_offset : NULL;
+}
+
+static bool DS_StrMapFindRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, DS_OUT void* out_val, int V_size, int elem_size, int val_offset) {
+	void* ptr = DS_StrMapFindPtrRaw(map, key_data, key_size, elem_size, val_offset);
+	if (ptr && out_val) memcpy(out_val, ptr, V_size);
+	return ptr != NULL;
+}
+
+static bool DS_StrMapGetOrAddRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, DS_OUT void** out_val_ptr, DS_OUT const DS_StrMapKey** out_key, int elem_size, int val_offset) {
+	DS_ProfEnter();
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_StrMapInit?
+	DS_ASSERT(key_size <= UINT32_MAX);
+
+	uint32_t hash = DS_StrMapHash(map, key_data, key_size);
+	char* elem = map->capacity > 0 ? DS_StrMapTableFind(map, key_data, (uint32_t)key_size, hash, elem_size) : NULL;
+	bool added_new = false;
+
+	if (elem == NULL) {
+		if (100 * (map->count + 1) > 70 * map->capacity) DS_StrMapGrow(map, elem_size);
+
+		// Intern the key bytes
+		char* interned = DS_ArenaPushAligned(&map->key_arena, key_size + 1, 1);
+		memcpy(interned, key_data, key_size);
+		interned[key_size] = 0;
+
+		char temp[DS_MAX_ELEM_SIZE];
+		DS_ASSERT(DS_MAX_ELEM_SIZE >= elem_size);
+		memset(temp, 0, elem_size);
+		DS_StrMapKey* temp_key = (DS_StrMapKey*)temp;
+		temp_key->hash = hash;
+		temp_key->size = (uint32_t)key_size;
+		temp_key->data = interned;
+
+		elem = DS_StrMapTablePlace(map, temp, hash, elem_size);
+		map->count++;
+		added_new = true;
+	}
+
+	if (out_val_ptr) *out_val_ptr = elem + val_offset;
+	if (out_key) *out_key = (const DS_StrMapKey*)elem;
+	DS_ProfExit();
+	return added_new;
+}
+
+static bool DS_StrMapInsertRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, const void* val, int V_size, int elem_size, int val_offset) {
+	void* val_ptr;
+	bool added = DS_StrMapGetOrAddRaw(map, key_data, key_size, &val_ptr, NULL, elem_size, val_offset);
+	memcpy(val_ptr, val, V_size);
+	return added;
+}
+
+static bool DS_StrMapRemoveRaw(DS_StrMapRaw* map, const void* key_data, size_t key_size, int elem_size) {
+	if (map->count == 0) return false;
+	DS_ProfEnter();
+	uint32_t hash = DS_StrMapHash(map, key_data, key_size);
+	char* elem = DS_StrMapTableFind(map, key_data, (uint32_t)key_size, hash, elem_size);
+	if (elem) {
+		memset(elem, 0, elem_size);
+		map->count--;
+
+		// backwards-shift deletion, same as in DS_MapTableRemove.
+		char temp[DS_MAX_ELEM_SIZE];
+		DS_ASSERT(DS_MAX_ELEM_SIZE >= elem_size);
+		uint32_t mask = (uint32_t)map->capacity - 1;
+		uint32_t index = (uint32_t)((elem - (char*)map->data) / elem_size);
+		for (;;) {
+			index = (index + 1) & mask;
+
+			char* shifting_elem_base = (char*)map->data + index * elem_size;
+			uint32_t shifting_elem_hash = *(uint32_t*)shifting_elem_base;
+			if (shifting_elem_hash == 0) break;
+
+			memcpy(temp, shifting_elem_base, elem_size);
+			memset(shifting_elem_base, 0, elem_size);
+			DS_StrMapTablePlace(map, temp, shifting_elem_hash, elem_size);
+		}
+	}
+	DS_ProfExit();
+	return elem != NULL;
+}
+
+// -- Concurrent map -------------------------------------------
+
+#define DS_CMapTableElems(TABLE) ((char*)(TABLE) + DS_AlignUpPow2(sizeof(DS_CMapTable), 16))
+
+static uint32_t DS_cmap_next_reader_stripe;
+static DS_THREAD_LOCAL uint32_t DS_cmap_reader_stripe_plus_one;
+
+static inline uint32_t DS_CMapHash(DS_ConcurrentMapRaw* map, const void* key, int K_size) {
+	uint32_t hash = map->hash_fn ? map->hash_fn(key, K_size) : DS_MapHashDefault(key, K_size);
+	return DS_MapFixHash(hash);
+}
+
+static inline DS_CMapShard* DS_CMapGetShard(DS_ConcurrentMapRaw* map, uint32_t hash) {
+	return &map->shards[hash >> (32 - DS_CMAP_SHARD_BITS)];
+}
+
+// * Returns the reader counter that was incremented, which must be passed to DS_CMapReadEnd.
+static inline volatile uint32_t* DS_CMapReadBegin(DS_ConcurrentMapRaw* map) {
+	if (DS_cmap_reader_stripe_plus_one == 0) {
+		DS_cmap_reader_stripe_plus_one = DS_AtomicAdd32(&DS_cmap_next_reader_stripe, 1) % DS_CMAP_READER_STRIPES + 1;
+	}
+	uint32_t stripe = DS_cmap_reader_stripe_plus_one - 1;
+
+	for (;;) {
+		uint32_t epoch = DS_AtomicLoad32(&map->epoch);
+		volatile uint32_t* counter = &map->readers[epoch & 1][stripe].count;
+		DS_AtomicAdd32(counter, 1);
+
+		// If the epoch advanced in the meantime, our increment might have gone to a counter which nobody will wait on. Try again.
+		if (DS_AtomicLoad32(&map->epoch) == epoch) return counter;
+		DS_AtomicAdd32(counter, (uint32_t)-1);
+	}
+}
+
+static inline void DS_CMapReadEnd(volatile uint32_t* counter) {
+	DS_AtomicAdd32(counter, (uint32_t)-1);
+}
+
+// Advances the epoch if every reader of the previous epoch has finished, then frees the tables which were retired at
+// least two epochs ago. Readers can only be in the current or the previous epoch, so no reader can see those tables.
+// The retired_lock must be held.
+static void DS_CMapTryReclaim(DS_ConcurrentMapRaw* map) {
+	uint32_t epoch = DS_AtomicLoad32(&map->epoch);
+	bool previous_epoch_is_quiet = true;
+	for (int i = 0; i < DS_CMAP_READER_STRIPES; i++) {
+		if (DS_AtomicLoad32(&map->readers[(epoch - 1) & 1][i].count) != 0) {
+			previous_epoch_is_quiet = false;
+			break;
+		}
+	}
+	if (previous_epoch_is_quiet) {
+		epoch = DS_AtomicAdd32(&map->epoch, 1) + 1;
+	}
+
+	for (DS_CMapTable** link = &map->retired; *link;) {
+		DS_CMapTable* table = *link;
+		if (epoch - table->retire_epoch >= 2) {
+			*link = table->retired_next;
+			DS_MemFree(map->allocator, table);
+		}
+		else {
+			link = &table->retired_next;
+		}
+	}
+}
+
+static void DS_CMapInitRaw(DS_ConcurrentMapRaw* map, DS_Allocator* allocator) {
+	memset(map, 0, sizeof(*map));
+	map->allocator = allocator;
+}
+
+static void DS_CMapDeinitRaw(DS_ConcurrentMapRaw* map) {
+	for (int i = 0; i < DS_CMAP_SHARD_COUNT; i++) {
+		if (map->shards[i].table) DS_MemFree(map->allocator, map->shards[i].table);
+	}
+	for (DS_CMapTable* table = map->retired; table;) {
+		DS_CMapTable* next = table->retired_next;
+		DS_MemFree(map->allocator, table);
+		table = next;
+	}
+	DS_DebugFillGarbage(map, sizeof(*map));
+}
+
+static void DS_CMapCollectRaw(DS_ConcurrentMapRaw* map) {
+	DS_SpinLockEnter(&map->retired_lock);
+	DS_CMapTryReclaim(map);
+	DS_CMapTryReclaim(map);
+	DS_SpinLockExit(&map->retired_lock);
+}
+
+static int DS_CMapCountRaw(DS_ConcurrentMapRaw* map) {
+	int count = 0;
+	for (int i = 0; i < DS_CMAP_SHARD_COUNT; i++) {
+		count += (int)DS_AtomicLoad32(&map->shards[i].count);
+	}
+	return count;
+}
+
+static bool DS_CMapFindRaw(DS_ConcurrentMapRaw* map, const void* key, DS_OUT void* out_val, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	DS_ProfEnter();
+	uint32_t hash = DS_CMapHash(map, key, K_size);
+	DS_CMapShard* shard = DS_CMapGetShard(map, hash);
+	bool found = false;
+
+	volatile uint32_t* reader_counter = DS_CMapReadBegin(map);
+
+	DS_CMapTable* table = (DS_CMapTable*)DS_AtomicLoadPtr((void* volatile*)&shard->table);
+	if (table) {
+		uint32_t mask = table->capacity - 1;
+		uint32_t index = hash & mask;
+		for (;;) {
+			char* elem = DS_CMapTableElems(table) + index * elem_size;
+			uint32_t elem_hash = DS_AtomicLoad32((volatile uint32_t*)elem);
+			if (elem_hash == 0) break;
+
+			// The key of a slot never changes after its hash is published, so it's safe to compare without a lock.
+			if (elem_hash == hash && memcmp(key, elem + key_offset, K_size) == 0) {
+				if (out_val) {
+					volatile uint32_t* seq = (volatile uint32_t*)(elem + sizeof(uint32_t));
+					for (;;) {
+						uint32_t seq_before = DS_AtomicLoad32(seq);
+						if (seq_before & 1) { DS_SpinPause(); continue; } // a writer is in the middle of updating the value
+						memcpy(out_val, elem + val_offset, V_size);
+						DS_AtomicFence();
+						if (DS_AtomicLoad32(seq) == seq_before) break;
+					}
+				}
+				found = true;
+				break;
+			}
+
+			index = (index + 1) & mask;
+		}
+	}
+
+	DS_CMapReadEnd(reader_counter);
+	DS_ProfExit();
+	return found;
+}
+
+// The shard lock must be held.
+static void DS_CMapShardGrow(DS_ConcurrentMapRaw* map, DS_CMapShard* shard, int elem_size) {
+	DS_ProfEnter();
+	DS_CMapTable* old_table = shard->table;
+
+	uint32_t new_capacity = 16;
+	while (100 * (shard->count + 1) > 35 * new_capacity) new_capacity *= 2;
+
+	size_t elems_offset = DS_AlignUpPow2(sizeof(DS_CMapTable), 16);
+	DS_CMapTable* new_table = (DS_CMapTable*)DS_MemAlloc(map->allocator, elems_offset + (size_t)new_capacity * elem_size);
+	memset(new_table, 0, elems_offset + (size_t)new_capacity * elem_size);
+	new_table->capacity = new_capacity;
+
+	if (old_table) {
+		uint32_t mask = new_capacity - 1;
+		for (uint32_t i = 0; i < old_table->capacity; i++) {
+			char* elem = DS_CMapTableElems(old_table) + i * elem_size;
+			uint32_t elem_hash = *(uint32_t*)elem;
+			if (elem_hash <= DS_MAP_TOMBSTONE_HASH) continue;
+
+			uint32_t index = elem_hash & mask;
+			while (*(uint32_t*)(DS_CMapTableElems(new_table) + index * elem_size) != 0) {
+				index = (index + 1) & mask;
+			}
+			memcpy(DS_CMapTableElems(new_table) + index * elem_size, elem, elem_size);
+		}
+	}
+
+	DS_AtomicStorePtr((void* volatile*)&shard->table, new_table); // publish
+	shard->used = shard->count;
+
+	if (old_table) {
+		DS_SpinLockEnter(&map->retired_lock);
+		old_table->retire_epoch = DS_AtomicLoad32(&map->epoch);
+		old_table->retired_next = map->retired;
+		map->retired = old_table;
+		DS_CMapTryReclaim(map);
+		DS_SpinLockExit(&map->retired_lock);
+	}
+	DS_ProfExit();
+}
+
+static bool DS_CMapGetOrAddRaw(DS_ConcurrentMapRaw* map, const void* key, const void* val, DS_OUT void* out_val, bool overwrite, int K_size, int V_size, int elem_size, int key_offset, int val_offset) {
+	DS_ProfEnter();
+	DS_ASSERT(map->allocator != NULL); // Have you called DS_CMapInit?
+
+	uint32_t hash = DS_CMapHash(map, key, K_size);
+	DS_CMapShard* shard = DS_CMapGetShard(map, hash);
+	bool added_new = false;
+
+	DS_SpinLockEnter(&shard->lock);
+
+	char* found = NULL;
+	if (shard->table) {
+		uint32_t mask = shard->table->capacity - 1;
+		for (uint32_t index = hash & mask;; index = (index + 1) & mask) {
+			char* elem = DS_CMapTableElems(shard->table) + index * elem_size;
+			uint32_t elem_hash = *(uint32_t*)elem;
+			if (elem_hash == 0) break;
+			if (elem_hash == hash && memcmp(key, elem + key_offset, K_size) == 0) {
+				found = elem;
+				break;
+			}
+		}
+	}
+
+	if (found) {
+		if (overwrite) {
+			// Make the sequence number odd while writing, so that readers know to retry.
+			volatile uint32_t* seq = (volatile uint32_t*)(found + sizeof(uint32_t));
+			uint32_t seq_before = *seq;
+			DS_AtomicStore32(seq, seq_before + 1);
+			DS_AtomicFence();
+			memcpy(found + val_offset, val, V_size);
+			DS_AtomicStore32(seq, seq_before + 2);
+		}
+		else if (out_val) {
+			memcpy(out_val, found + val_offset, V_size); // we're the only writer, so no need to check the sequence number
+		}
+	}
+	else {
+		if (shard->table == NULL || 100 * (shard->used + 1) > 70 * shard->table->capacity) {
+			DS_CMapShardGrow(map, shard, elem_size);
+		}
+
+		uint32_t mask = shard->table->capacity - 1;
+		uint32_t index = hash & mask;
+		while (*(uint32_t*)(DS_CMapTableElems(shard->table) + index * elem_size) != 0) {
+			index = (index + 1) & mask;
+		}
+
+		char* elem = DS_CMapTableElems(shard->table) + index * elem_size;
+		memcpy(elem + key_offset, key, K_size);
+		memcpy(elem + val_offset, val, V_size);
+		DS_AtomicStore32((volatile uint32_t*)elem, hash); // publish
+
+		shard->used++;
+		DS_AtomicAdd32(&shard->count, 1);
+		added_new = true;
+	}
+
+	DS_SpinLockExit(&shard->lock);
+	DS_ProfExit();
+	return added_new;
+}
+
+static bool DS_CMapRemoveRaw(DS_ConcurrentMapRaw* map, const void* key, int K_size, int elem_size, int key_offset) {
+	DS_ProfEnter();
+	uint32_t hash = DS_CMapHash(map, key, K_size);
+	DS_CMapShard* shard = DS_CMapGetShard(map, hash);
+	bool removed = false;
+
+	DS_SpinLockEnter(&shard->lock);
+	if (shard->table) {
+		uint32_t mask = shard->table->capacity - 1;
+		for (uint32_t index = hash & mask;; index = (index + 1) & mask) {
+			char* elem = DS_CMapTableElems(shard->table) + index * elem_size;
+			uint32_t elem_hash = *(uint32_t*)elem;
+			if (elem_hash == 0) break;
+			if (elem_hash == hash && memcmp(key, elem + key_offset, K_size) == 0) {
+				// Leave a tombstone, since readers may be probing past this slot right now
+				DS_AtomicStore32((volatile uint32_t*)elem, DS_MAP_TOMBSTONE_HASH);
+				DS_AtomicAdd32(&shard->count, (uint32_t)-1);
+				removed = true;
+				break;
+			}
+		}
+	}
+	DS_SpinLockExit(&shard->lock);
+
+	DS_ProfExit();
+	return removed;
+}
+
+#ifndef DS_NO_VIRTUAL_MEMORY
+#ifdef _WIN32
+// -- from Windows.h -----------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef _WIN64
+typedef unsigned __int64 DS_WinSizeT; // SIZE_T
+#else
+typedef unsigned long DS_WinSizeT;
+#endif
+__declspec(dllimport) void* __stdcall VirtualAlloc(void* lpAddress, DS_WinSizeT dwSize, unsigned long flAllocationType, unsigned long flProtect);
+__declspec(dllimport) int __stdcall VirtualFree(void* lpAddress, DS_WinSizeT dwSize, unsigned long dwFreeType);
+__declspec(dllimport) DS_WinSizeT __stdcall GetLargePageMinimum(void);
+#ifdef __cplusplus
+} // extern "C"
+#endif
+#define DS_MEM_COMMIT      0x00001000
+#define DS_MEM_RESERVE     0x00002000
+#define DS_MEM_DECOMMIT    0x00004000
+#define DS_MEM_RELEASE     0x00008000
+#define DS_MEM_LARGE_PAGES 0x20000000
+#define DS_PAGE_NOACCESS   0x01
+#define DS_PAGE_READWRITE  0x04
+// -----------------------------------------------------------
+
+static void* DS_VirtualReserve(size_t size) { return VirtualAlloc(NULL, size, DS_MEM_RESERVE, DS_PAGE_NOACCESS); }
+static bool DS_VirtualCommit(void* ptr, size_t size) { return VirtualAlloc(ptr, size, DS_MEM_COMMIT, DS_PAGE_READWRITE) != NULL; }
+static void DS_VirtualDecommit(void* ptr, size_t size) { VirtualFree(ptr, size, DS_MEM_DECOMMIT); }
+static void DS_VirtualRelease(void* ptr, size_t size) { VirtualFree(ptr, 0, DS_MEM_RELEASE); }
+
+// Large pages can't be committed lazily on Windows, so the whole range is reserved and committed at once.
+static void* DS_VirtualReserveHuge(size_t* size) {
+	size_t large_page_size = GetLargePageMinimum();
+	if (large_page_size == 0) return NULL;
+	*size = DS_AlignUpPow2(*size, large_page_size);
+	return VirtualAlloc(NULL, *size, DS_MEM_RESERVE | DS_MEM_COMMIT | DS_MEM_LARGE_PAGES, DS_PAGE_READWRITE);
+}
+#else
+static void* DS_VirtualReserve(size_t size) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	void* ptr = mmap(NULL, size, PROT_NONE, flags, -1, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+static bool DS_VirtualCommit(void* ptr, size_t size) { return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0; }
+static void DS_VirtualDecommit(void* ptr, size_t size) {
+	madvise(ptr, size, MADV_DONTNEED); // give the physical pages back
+	mprotect(ptr, size, PROT_NONE);
+}
+static void DS_VirtualRelease(void* ptr, size_t size) { munmap(ptr, size); }
+
+// Reserves a DS_ARENA_HUGE_PAGE_SIZE aligned range and asks for transparent huge pages in it.
+static void* DS_VirtualReserveHuge(size_t* size) {
+#ifdef MADV_HUGEPAGE
+	char* ptr = (char*)DS_VirtualReserve(*size + DS_ARENA_HUGE_PAGE_SIZE);
+	if (ptr == NULL) return NULL;
+
+	// Trim the unaligned head and the tail of the over-sized reservation
+	char* aligned = (char*)DS_AlignUpPow2((uintptr_t)ptr, DS_ARENA_HUGE_PAGE_SIZE);
+	if (aligned > ptr) munmap(ptr, aligned - ptr);
+	munmap(aligned + *size, (ptr + DS_ARENA_HUGE_PAGE_SIZE) - aligned);
+
+	if (madvise(aligned, *size, MADV_HUGEPAGE) != 0) {
+		munmap(aligned, *size);
+		return NULL;
+	}
+	return aligned;
+#else
+	return NULL;
+#endif
+}
+#endif
+
+static void DS_VirtualPrefault(void* ptr, size_t size) {
+#if !defined(_WIN32) && defined(MADV_POPULATE_WRITE)
+	if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0) return; // Linux 5.14+
+#endif
+	// Committed memory reads as zero, so writing a zero to every page faults it in without changing anything.
+	for (size_t offset = 0; offset < size; offset += DS_KIB(4)) {
+		((volatile char*)ptr)[offset] = 0;
+	}
+}
+
+// Returns false if the OS is out of memory, in which case nothing is committed.
+static bool DS_ArenaCommit(DS_Arena* arena, char* end) {
+	DS_ProfEnter();
+	char* new_committed_end = (char*)DS_AlignUpPow2((uintptr_t)end, arena->commit_size);
+	bool ok = DS_VirtualCommit(arena->committed_end, new_committed_end - arena->committed_end);
+	if (ok) {
+		if (arena->flags & DS_ArenaFlag_Prefault) DS_VirtualPrefault(arena->committed_end, new_committed_end - arena->committed_end);
+		arena->committed_end = new_committed_end;
+	}
+	DS_ProfExit();
+	return ok;
+}
+
+static void DS_ArenaDecommitAbove(DS_Arena* arena, char* ptr) {
+#ifdef _WIN32
+	if (arena->flags & DS_ArenaFlag_HugePages) return; // Large pages can't be decommitted
+#endif
+	char* keep_end = (char*)DS_AlignUpPow2((uintptr_t)ptr, arena->commit_size);
+	if (keep_end < (char*)arena->first_block + arena->commit_size) keep_end = (char*)arena->first_block + arena->commit_size;
+
+	if (keep_end < arena->committed_end && (size_t)(arena->committed_end - keep_end) > DS_ARENA_DECOMMIT_THRESHOLD) {
+		DS_ProfEnter();
+		DS_VirtualDecommit(keep_end, arena->committed_end - keep_end);
+		arena->committed_end = keep_end;
+		if (arena->dirty_end > keep_end) arena->dirty_end = keep_end;
+		DS_ProfExit();
+	}
+}
+#endif
+
+#if defined(DS_ARENA_STATS) || defined(DS_ALLOCATOR_TRACKING)
+// Builds a null-terminated report string in an arena, shared by DS_ArenaStatsDump and DS_TrackingDump.
+typedef struct DS_StatsWriter {
+	DS_Arena* out;
+	char* data;
+	size_t length;
+	size_t capacity;
+} DS_StatsWriter;
+
+static void DS_StatsAppend(DS_StatsWriter* w, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int length = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	if (w->length + length + 1 > w->capacity) {
+		size_t new_capacity = w->capacity * 2;
+		if (new_capacity < w->length + length + 1) new_capacity = w->length + length + 1;
+		w->data = (char*)DS_MemResizeAligned(w->out, w->data, w->capacity, new_capacity, 1);
+		w->capacity = new_capacity;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(w->data + w->length, length + 1, fmt, args);
+	va_end(args);
+	w->length += length;
+}
+#endif
+
+#ifdef DS_ARENA_STATS
+typedef struct DS_ArenaStatsSiteTag { const char* file; int line; } DS_ArenaStatsSiteTag;
+static DS_THREAD_LOCAL DS_ArenaStatsSiteTag DS_arena_stats_site; // Set by the call-site macros, consumed by the next push
+
+static inline void DS_ArenaStatsSetSite_(const char* file, int line) {
+	DS_arena_stats_site.file = file;
+	DS_arena_stats_site.line = line;
+}
+
+static void DS_ArenaStatsUpdatePeak(DS_Arena* arena) {
+	DS_ArenaStats* stats = &arena->stats;
+	if (stats->bytes_used > stats->peak_bytes_used) stats->peak_bytes_used = stats->bytes_used;
+	if (stats->bytes_used > stats->peak_bytes_used_ever) stats->peak_bytes_used_ever = stats->bytes_used;
+}
+
+// Recomputes bytes_used after the mark has moved backwards
+static void DS_ArenaStatsRecount(DS_Arena* arena) {
+	size_t used = 0;
+	if (arena->mark.block) {
+		for (DS_ArenaBlockHeader* block = arena->first_block; block != arena->mark.block; block = block->next) {
+			used += block->size_including_header;
+		}
+		used += arena->mark.ptr - (char*)arena->mark.block;
+	}
+	arena->stats.bytes_used = used;
+}
+
+static void DS_ArenaStatsOnReset(DS_Arena* arena) {
+	arena->stats.peak_bytes_used_before_reset = arena->stats.peak_bytes_used;
+	arena->stats.peak_bytes_used = 0;
+	DS_ArenaStatsRecount(arena);
+}
+
+static void DS_ArenaStatsRecordPush(DS_Arena* arena, DS_ArenaBlockHeader* prev_block, char* prev_ptr, char* result, size_t size, bool allocated_block) {
+	DS_ArenaStats* stats = &arena->stats;
+	stats->push_count++;
+	stats->bytes_pushed += size;
+
+	if (arena->mark.block == prev_block) {
+		stats->alignment_padding += result - prev_ptr;
+		stats->bytes_used += (result - prev_ptr) + size;
+	}
+	else {
+		if (prev_block) {
+			size_t tail = (char*)prev_block + prev_block->size_including_header - prev_ptr;
+			stats->block_tail_waste += tail;
+			stats->bytes_used += tail;
+		}
+		char* block_data = (char*)arena->mark.block + sizeof(DS_ArenaBlockHeader);
+		stats->alignment_padding += result - block_data;
+		stats->bytes_used += (result - (char*)arena->mark.block) + size;
+		if (allocated_block) stats->blocks_allocated++;
+		else stats->blocks_reused++;
+	}
+	DS_ArenaStatsUpdatePeak(arena);
+
+	// Find or add the call site. Sites are few, so a linear scan is fine.
+	DS_ArenaStatsSiteTag tag = DS_arena_stats_site;
+	DS_arena_stats_site.file = NULL;
+	DS_arena_stats_site.line = 0;
+
+	DS_ArenaStatsSite* site = NULL;
+	for (int i = 0; i < stats->sites_count; i++) {
+		if (stats->sites[i].file == tag.file && stats->sites[i].line == tag.line) { site = &stats->sites[i]; break; }
+	}
+	if (site == NULL && stats->sites_count < DS_ARENA_STATS_MAX_SITES) {
+		site = &stats->sites[stats->sites_count++];
+		site->file = tag.file;
+		site->line = tag.line;
+	}
+	if (site) {
+		site->push_count++;
+		site->bytes += size;
+	}
+	else stats->sites_dropped++;
+}
+
+DS_API char* DS_ArenaStatsDump(DS_Arena* arena, DS_Arena* out, bool json) {
+	DS_ArenaStats* stats = &arena->stats;
+
+	// Sort the sites by bytes, largest first
+	int order[DS_ARENA_STATS_MAX_SITES];
+	for (int i = 0; i < stats->sites_count; i++) {
+		int j = i;
+		for (; j > 0 && stats->sites[order[j - 1]].bytes < stats->sites[i].bytes; j--) order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	DS_StatsWriter writer = {out};
+	DS_StatsWriter* w = &writer;
+	DS_StatsAppend(w, "");
+
+	if (json) {
+		DS_StatsAppend(w, "{\"push_count\": %llu, \"bytes_pushed\": %llu, \"alignment_padding\": %llu, \"block_tail_waste\": %llu, "
+			"\"blocks_allocated\": %llu, \"blocks_reused\": %llu, \"total_mem_reserved\": %llu, \"bytes_used\": %llu, "
+			"\"peak_bytes_used\": %llu, \"peak_bytes_used_before_reset\": %llu, \"peak_bytes_used_ever\": %llu, \"sites_dropped\": %llu, \"sites\": [",
+			(unsigned long long)stats->push_count, (unsigned long long)stats->bytes_pushed, (unsigned long long)stats->alignment_padding,
+			(unsigned long long)stats->block_tail_waste, (unsigned long long)stats->blocks_allocated, (unsigned long long)stats->blocks_reused,
+			(unsigned long long)arena->total_mem_reserved, (unsigned long long)stats->bytes_used, (unsigned long long)stats->peak_bytes_used,
+			(unsigned long long)stats->peak_bytes_used_before_reset, (unsigned long long)stats->peak_bytes_used_ever, (unsigned long long)stats->sites_dropped);
+		for (int i = 0; i < stats->sites_count; i++) {
+			DS_ArenaStatsSite* site = &stats->sites[order[i]];
+			DS_StatsAppend(w, "%s{\"file\": ", i > 0 ? ", " : "");
+			if (site->file) {
+				DS_StatsAppend(w, "\"");
+				for (const char* c = site->file; *c; c++) { // escape Windows path separators
+					DS_StatsAppend(w, *c == '\\' || *c == '"' ? "\\%c" : "%c", *c);
+				}
+				DS_StatsAppend(w, "\"");
+			}
+			else DS_StatsAppend(w, "null");
+			DS_StatsAppend(w, ", \"line\": %d, \"push_count\": %llu, \"bytes\": %llu}",
+				site->line, (unsigned long long)site->push_count, (unsigned long long)site->bytes);
+		}
+		DS_StatsAppend(w, "]}\n");
+	}
+	else {
+		DS_StatsAppend(w, "pushes: %llu (%llu bytes)\nalignment padding: %llu bytes\nblock tail waste: %llu bytes\n"
+			"blocks: %llu allocated, %llu reused, %llu bytes reserved\nused: %llu bytes, peak since reset %llu bytes, peak before reset %llu bytes, peak ever %llu bytes\n",
+			(unsigned long long)stats->push_count, (unsigned long long)stats->bytes_pushed, (unsigned long long)stats->alignment_padding,
+			(unsigned long long)stats->block_tail_waste, (unsigned long long)stats->blocks_allocated, (unsigned long long)stats->blocks_reused,
+			(unsigned long long)arena->total_mem_reserved, (unsigned long long)stats->bytes_used, (unsigned long long)stats->peak_bytes_used,
+			(unsigned long long)stats->peak_bytes_used_before_reset, (unsigned long long)stats->peak_bytes_used_ever);
+		for (int i = 0; i < stats->sites_count; i++) {
+			DS_ArenaStatsSite* site = &stats->sites[order[i]];
+			DS_StatsAppend(w, "  %12llu bytes %10llu pushes  %s:%d\n", (unsigned long long)site->bytes, (unsigned long long)site->push_count,
+				site->file ? site->file : "(allocator proc)", site->line);
+		}
+		if (stats->sites_dropped) DS_StatsAppend(w, "  %llu pushes from untracked sites\n", (unsigned long long)stats->sites_dropped);
+	}
+
+	return writer.data;
+}
+#endif
+
+// Must be called before moving the mark of a virtual memory arena backwards, see DS_Arena::dirty_end
+static inline void DS_ArenaMarkDirty(DS_Arena* arena) {
+	if (arena->mark.ptr > arena->dirty_end) arena->dirty_end = arena->mark.ptr;
+}
+
+static void* DS_ArenaAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	DS_Arena* arena = (DS_Arena*)allocator;
+
+	// If this is the most recent allocation in the arena, it can be grown, shrunk or freed in place by moving the mark,
+	// as long as it still fits in the current block. This makes a growing array at the top of an arena free of copies and waste.
+	if (ptr && (char*)ptr + old_size == arena->mark.ptr && ((uintptr_t)ptr & (align - 1)) == 0) {
+		char* block_end = (char*)arena->mark.block + arena->mark.block->size_including_header;
+		if (size <= (size_t)(block_end - (char*)ptr)) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+			if (arena->committed_end && (char*)ptr + size > arena->committed_end && !DS_ArenaCommit(arena, (char*)ptr + size)) return NULL;
+			if (arena->committed_end) DS_ArenaMarkDirty(arena);
+#endif
+#ifdef DS_ARENA_STATS
+			arena->stats.bytes_used += size - old_size;
+			DS_ArenaStatsUpdatePeak(arena);
+#endif
+			arena->mark.ptr = (char*)ptr + size;
+			return size ? ptr : NULL;
+		}
+	}
+
+	char* data = DS_ArenaPushAligned(arena, size, align);
+	if (data == NULL) return NULL;
+	if (ptr) memcpy(data, ptr, old_size < size ? old_size : size);
+	return data;
+}
+
+DS_API void DS_ArenaInit(DS_Arena* arena, size_t block_size, DS_Allocator* allocator) {
+	memset(arena, 0, sizeof(*arena));
+	arena->base.ds = allocator->base.ds;
+	arena->base.allocator_proc = DS_ArenaAllocatorProc;
+	arena->block_size = block_size;
+	arena->next_block_size = block_size;
+	arena->max_block_size = block_size;
+	arena->allocator = allocator;
+}
+
+DS_API void DS_ArenaSetMaxBlockSize(DS_Arena* arena, size_t max_block_size) {
+	DS_ASSERT(max_block_size >= arena->block_size);
+	arena->max_block_size = max_block_size;
+	if (arena->next_block_size > max_block_size) arena->next_block_size = max_block_size;
+}
+
+#ifndef DS_NO_VIRTUAL_MEMORY
+DS_API void DS_ArenaInitVirtual(DS_Arena* arena, size_t reserve_size, DS_Info* ds) {
+	DS_ArenaInitVirtualEx(arena, reserve_size, 0, ds);
+}
+
+// A virtual memory arena consists of a single block spanning the whole reserved range, so that the regular
+// DS_ArenaPushAligned / DS_ArenaSetMark logic applies unchanged.
+DS_API DS_ArenaFlags DS_ArenaInitVirtualEx(DS_Arena* arena, size_t reserve_size, DS_ArenaFlags flags, DS_Info* ds) {
+	memset(arena, 0, sizeof(*arena));
+	arena->base.ds = ds;
+	arena->base.allocator_proc = DS_ArenaAllocatorProc;
+	arena->commit_size = DS_ARENA_COMMIT_SIZE; // Marks the arena as virtual even if the reservation below fails
+	reserve_size = DS_AlignUpPow2(reserve_size, DS_ARENA_COMMIT_SIZE);
+
+	DS_ArenaBlockHeader* block = NULL;
+	size_t initial_commit_size = DS_ARENA_COMMIT_SIZE;
+	bool already_committed = false;
+	if (flags & DS_ArenaFlag_HugePages) {
+		size_t huge_reserve_size = DS_AlignUpPow2(reserve_size, DS_ARENA_HUGE_PAGE_SIZE);
+		block = (DS_ArenaBlockHeader*)DS_VirtualReserveHuge(&huge_reserve_size);
+		if (block) {
+			arena->flags |= DS_ArenaFlag_HugePages;
+			reserve_size = huge_reserve_size;
+#ifdef _WIN32
+			initial_commit_size = reserve_size;
+			already_committed = true;
+#else
+			arena->commit_size = DS_ARENA_HUGE_PAGE_SIZE;
+			initial_commit_size = DS_ARENA_HUGE_PAGE_SIZE;
+#endif
+		}
+	}
+	if (block == NULL) {
+		block = (DS_ArenaBlockHeader*)DS_VirtualReserve(reserve_size);
+		if (block == NULL) return 0; // Failed to reserve address space
+	}
+
+	if (!already_committed && !DS_VirtualCommit(block, initial_commit_size)) {
+		DS_VirtualRelease(block, reserve_size);
+		arena->flags = 0;
+		return 0;
+	}
+	if (flags & DS_ArenaFlag_Prefault) {
+		arena->flags |= DS_ArenaFlag_Prefault;
+		DS_VirtualPrefault(block, initial_commit_size);
+	}
+	block->size_including_header = reserve_size;
+	block->next = NULL;
+
+	arena->block_size = reserve_size;
+	arena->total_mem_reserved = reserve_size;
+	arena->first_block = block;
+	arena->mark.block = block;
+	arena->mark.ptr = (char*)block + sizeof(DS_ArenaBlockHeader);
+	arena->committed_end = (char*)block + initial_commit_size;
+	arena->dirty_end = arena->mark.ptr;
+	return arena->flags;
+}
+#endif
+
+DS_API void DS_ArenaDeinit(DS_Arena* arena) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end) {
+		DS_VirtualRelease(arena->first_block, arena->first_block->size_including_header);
+		DS_DebugFillGarbage(arena, sizeof(DS_Arena));
+		return;
+	}
+#endif
+	for (DS_ArenaBlockHeader* block = arena->first_block; block;) {
+		DS_ArenaBlockHeader* next = block->next;
+		DS_MemFree(arena->allocator, block);
+		block = next;
+	}
+	DS_DebugFillGarbage(arena, sizeof(DS_Arena));
+}
+
+DS_API char* DS_ArenaPush(DS_Arena* arena, size_t size) {
+	return DS_ArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+}
+
+DS_API char* DS_ArenaPushZero(DS_Arena* arena, size_t size) {
+#ifndef DS_NO_VIRTUAL_MEMORY
+	char* prev_mark_ptr = arena->mark.ptr;
+#endif
+	char* ptr = DS_ArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+	if (ptr == NULL) return NULL;
+	size_t dirty_size = size;
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end) {
+		// Fresh pages from the OS are zero, so only the part below the highest mark ever reached needs clearing.
+		char* zero_start = prev_mark_ptr > arena->dirty_end ? prev_mark_ptr : arena->dirty_end;
+		dirty_size = zero_start <= ptr ? 0 : (size_t)(zero_start - ptr) < size ? (size_t)(zero_start - ptr) : size;
+	}
+#endif
+	memset(ptr, 0, dirty_size);
+	return ptr;
+}
+
+DS_API char* DS_ArenaPushAligned(DS_Arena* arena, size_t size, size_t alignment) {
+	DS_ProfEnter();
+
+	bool alignment_is_power_of_2 = ((alignment) & ((alignment)-1)) == 0;
+	DS_ASSERT(alignment != 0 && alignment_is_power_of_2);
+
+	DS_ArenaBlockHeader* curr_block = arena->mark.block; // may be NULL
+	void* curr_ptr = arena->mark.ptr;
+
+	char* result_address = (char*)DS_AlignUpPow2((intptr_t)curr_ptr, alignment);
+	intptr_t remaining_space = curr_block ? curr_block->size_including_header - ((intptr_t)result_address - (intptr_t)curr_block) : 0;
+#ifdef DS_ARENA_STATS
+	bool allocated_block = false;
+#endif
+
+	if ((intptr_t)size > remaining_space) { // We need a new block!
+		if (arena->commit_size) { // A virtual memory arena ran out of its reserved address space
+			DS_ProfExit();
+			return NULL;
+		}
+		// Blocks are only DS_ARENA_BLOCK_ALIGNMENT aligned, so for larger alignments the offset of the result
+		// within a block depends on the block address. Reserve room for the worst case.
+		intptr_t max_result_offset = alignment <= DS_ARENA_BLOCK_ALIGNMENT ?
+			DS_AlignUpPow2(sizeof(DS_ArenaBlockHeader), alignment) :
+			DS_AlignUpPow2(sizeof(DS_ArenaBlockHeader), DS_ARENA_BLOCK_ALIGNMENT) + alignment - DS_ARENA_BLOCK_ALIGNMENT;
+		intptr_t new_block_size = max_result_offset + size;
+		if ((intptr_t)arena->next_block_size > new_block_size) new_block_size = arena->next_block_size;
+
+		DS_ArenaBlockHeader* new_block = NULL;
+		DS_ArenaBlockHeader* next_block = NULL;
+
+		// If there is a block at the end of the list that we have used previously, but aren't using anymore, then try to start using that one.
+		if (curr_block && curr_block->next) {
+			next_block = curr_block->next;
+
+			intptr_t next_result_offset = DS_AlignUpPow2((intptr_t)next_block + sizeof(DS_ArenaBlockHeader), alignment) - (intptr_t)next_block;
+			intptr_t next_block_remaining_space = next_block->size_including_header - next_result_offset;
+			if ((intptr_t)size <= next_block_remaining_space) {
+				new_block = next_block; // Next block has enough space, let's use it!
+			}
+		}
+
+		// Otherwise, insert a new block.
+		if (new_block == NULL) {
+			new_block = (DS_ArenaBlockHeader*)DS_MemAllocAligned(arena->allocator, new_block_size, DS_ARENA_BLOCK_ALIGNMENT);
+			DS_ASSERT(((uintptr_t)new_block & (DS_ARENA_BLOCK_ALIGNMENT - 1)) == 0); // make sure that the alignment is correct
+	
+			new_block->size_including_header = new_block_size;
+			new_block->next = next_block;
+			arena->total_mem_reserved += new_block_size;
+
+			if (arena->next_block_size < arena->max_block_size) {
+				arena->next_block_size *= 2;
+				if (arena->next_block_size > arena->max_block_size) arena->next_block_size = arena->max_block_size;
+			}
+
+			if (curr_block) curr_block->next = new_block;
+			else arena->first_block = new_block;
+#ifdef DS_ARENA_STATS
+			allocated_block = true;
+#endif
+		}
+
+		arena->mark.block = new_block;
+		result_address = (char*)DS_AlignUpPow2((intptr_t)new_block + sizeof(DS_ArenaBlockHeader), alignment);
+	}
+
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end && result_address + size > arena->committed_end && !DS_ArenaCommit(arena, result_address + size)) {
+		DS_ProfExit();
+		return NULL; // Out of memory
+	}
+#endif
+
+#ifdef DS_ARENA_STATS
+	DS_ArenaStatsRecordPush(arena, curr_block, (char*)curr_ptr, result_address, size, allocated_block);
+#endif
+	arena->mark.ptr = result_address + size;
+	return result_address;
+	DS_ProfExit();
+}
+
+DS_API void DS_ArenaSetRetention(DS_Arena* arena, size_t retain_size, int retain_resets) {
+	arena->retain_size = retain_size;
+	arena->retain_resets = retain_resets;
+	arena->resets_in_window = 0;
+	arena->high_water_curr_window = 0;
+	arena->high_water_prev_window = 0;
+}
+
+// Returns how many bytes DS_ArenaReset may keep, and advances the high-water window.
+static size_t DS_ArenaRetainBudget(DS_Arena* arena, size_t used) {
+	size_t budget = arena->retain_size;
+	if (arena->retain_resets > 0) {
+		if (used > arena->high_water_curr_window) arena->high_water_curr_window = used;
+		if (arena->high_water_curr_window > budget) budget = arena->high_water_curr_window;
+		if (arena->high_water_prev_window > budget) budget = arena->high_water_prev_window;
+
+		// Two alternating windows approximate a sliding window of `retain_resets` resets
+		if (++arena->resets_in_window >= arena->retain_resets) {
+			arena->high_water_prev_window = arena->high_water_curr_window;
+			arena->high_water_curr_window = 0;
+			arena->resets_in_window = 0;
+		}
+	}
+	return budget;
+}
+
+DS_API void DS_ArenaReset(DS_Arena* arena) {
+	DS_ProfEnter();
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end) {
+		char* base = (char*)arena->first_block;
+		size_t budget = DS_ArenaRetainBudget(arena, arena->mark.ptr - base);
+		DS_ArenaMarkDirty(arena);
+		arena->mark.block = arena->first_block;
+		arena->mark.ptr = base + sizeof(DS_ArenaBlockHeader);
+		DS_ArenaDecommitAbove(arena, budget > sizeof(DS_ArenaBlockHeader) ? base + budget : arena->mark.ptr);
+#ifdef DS_ARENA_STATS
+		DS_ArenaStatsOnReset(arena);
+#endif
+		DS_ProfExit();
+		return;
+	}
+#endif
+	if (arena->first_block) {
+		// Measure the memory used by this round, i.e. the size of the blocks up to and including the marked block
+		size_t used = 0;
+		if (arena->mark.block) {
+			for (DS_ArenaBlockHeader* block = arena->first_block; ; block = block->next) {
+				used += block->size_including_header;
+				if (block == arena->mark.block) break;
+			}
+		}
+
+		// By default, keep only the first block, and only if it's not larger than the regular block size
+		size_t budget = DS_ArenaRetainBudget(arena, used);
+		if (budget < arena->block_size) budget = arena->block_size;
+
+		// Keep the longest run of blocks from the start that fits in the budget, free the rest. The block size growth
+		// restarts from the kept blocks, so that the next round doesn't immediately allocate max size blocks again.
+		size_t kept = 0;
+		DS_ArenaBlockHeader* last_kept = NULL;
+		arena->next_block_size = arena->block_size;
+		for (DS_ArenaBlockHeader* block = arena->first_block; block; block = block->next) {
+			if (kept + block->size_including_header > budget) break;
+			kept += block->size_including_header;
+			last_kept = block;
+			if (arena->next_block_size < arena->max_block_size) {
+				arena->next_block_size *= 2;
+				if (arena->next_block_size > arena->max_block_size) arena->next_block_size = arena->max_block_size;
+			}
+		}
+
+		for (DS_ArenaBlockHeader* block = last_kept ? last_kept->next : arena->first_block; block;) {
+			DS_ArenaBlockHeader* next = block->next;
+			arena->total_mem_reserved -= block->size_including_header;
+			DS_MemFree(arena->allocator, block);
+			block = next;
+		}
+
+		if (last_kept) last_kept->next = NULL;
+		else arena->first_block = NULL;
+	}
+	arena->mark.block = arena->first_block;
+	arena->mark.ptr = (char*)arena->first_block + sizeof(DS_ArenaBlockHeader);
+#ifdef DS_ARENA_STATS
+	DS_ArenaStatsOnReset(arena);
+#endif
+	DS_ProfExit();
+}
+
+DS_API DS_ArenaMark DS_ArenaGetMark(DS_Arena* arena) {
+	return arena->mark;
+}
+
+DS_API void DS_ArenaSetMark(DS_Arena* arena, DS_ArenaMark mark) {
+	DS_ProfEnter();
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end) DS_ArenaMarkDirty(arena);
+#endif
+	if (mark.block == NULL) {
+		arena->mark.block = arena->first_block;
+		arena->mark.ptr = (char*)arena->first_block + sizeof(DS_ArenaBlockHeader);
+	}
+	else {
+		arena->mark = mark;
+	}
+#ifndef DS_NO_VIRTUAL_MEMORY
+	if (arena->committed_end) DS_ArenaDecommitAbove(arena, arena->mark.ptr);
+#endif
+#ifdef DS_ARENA_STATS
+	DS_ArenaStatsRecount(arena);
+#endif
+	DS_ProfExit();
+}
+
+#if !defined(DS_NO_VIRTUAL_MEMORY) || !defined(DS_NO_MALLOC)
+static DS_THREAD_LOCAL DS_Arena DS_scratch_arenas[DS_SCRATCH_ARENA_COUNT];
+static DS_THREAD_LOCAL DS_Info DS_scratch_info; // temp_arena is NULL until the scratch arenas are initialized
+#ifdef DS_NO_VIRTUAL_MEMORY
+static DS_THREAD_LOCAL DS_AllocatorBase DS_scratch_heap_allocator;
+#endif
+
+DS_API DS_Scope DS_ScratchBeginN(DS_Arena* const* conflicts, int conflicts_count) {
+	DS_ProfEnter();
+	if (DS_scratch_info.temp_arena == NULL) {
+		DS_scratch_info.temp_arena = &DS_scratch_arenas[0];
+#ifdef DS_NO_VIRTUAL_MEMORY
+		DS_scratch_heap_allocator.ds = &DS_scratch_info;
+		DS_scratch_heap_allocator.allocator_proc = DS_HeapAllocatorProc;
+#endif
+		for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) {
+#ifdef DS_NO_VIRTUAL_MEMORY
+			DS_ArenaInit(&DS_scratch_arenas[i], DS_SCRATCH_ARENA_BLOCK_SIZE, (DS_Allocator*)&DS_scratch_heap_allocator);
+#else
+			DS_ArenaInitVirtual(&DS_scratch_arenas[i], DS_SCRATCH_ARENA_RESERVE_SIZE, &DS_scratch_info);
+#endif
+		}
+	}
+
+	DS_Arena* arena = NULL;
+	for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) {
+		bool conflicting = false;
+		for (int j = 0; j < conflicts_count; j++) {
+			if (conflicts[j] == &DS_scratch_arenas[i]) { conflicting = true; break; }
+		}
+		if (!conflicting) { arena = &DS_scratch_arenas[i]; break; }
+	}
+	DS_ASSERT(arena != NULL); // Too many conflicts! Increase DS_SCRATCH_ARENA_COUNT.
+
+	DS_Scope scope = {arena, arena->mark};
+	DS_ProfExit();
+	return scope;
+}
+
+DS_API void DS_ScratchThreadDeinit(void) {
+	if (DS_scratch_info.temp_arena) {
+		for (int i = 0; i < DS_SCRATCH_ARENA_COUNT; i++) DS_ArenaDeinit(&DS_scratch_arenas[i]);
+		DS_scratch_info.temp_arena = NULL;
+	}
+}
+#endif
+
+#define DS_CONCURRENT_ARENA_HEADER_SIZE DS_AlignUpPow2(sizeof(DS_ConcurrentArenaBlock), DS_ARENA_BLOCK_ALIGNMENT)
+
+static void* DS_ConcurrentArenaAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	if (size == 0) return NULL; // Individual allocations can't be freed
+	char* data = DS_ConcurrentArenaPushAligned((DS_ConcurrentArena*)allocator, size, align);
+	if (ptr) memcpy(data, ptr, old_size < size ? old_size : size);
+	return data;
+}
+
+DS_API void DS_ConcurrentArenaInit(DS_ConcurrentArena* arena, size_t block_size, DS_Allocator* allocator) {
+	memset(arena, 0, sizeof(*arena));
+	arena->base.ds = allocator->base.ds;
+	DS_ASSERT(block_size >= 2 * DS_CONCURRENT_ARENA_HEADER_SIZE);
+	arena->base.allocator_proc = DS_ConcurrentArenaAllocatorProc;
+	arena->block_size = block_size;
+	arena->allocator = allocator;
+}
+
+static void DS_ConcurrentArenaFreeBlocks(DS_ConcurrentArena* arena, DS_ConcurrentArenaBlock* block) {
+	for (; block;) {
+		DS_ConcurrentArenaBlock* next = block->next;
+		arena->total_mem_reserved -= block->size_including_header;
+		DS_MemFree(arena->allocator, block);
+		block = next;
+	}
+}
+
+DS_API void DS_ConcurrentArenaDeinit(DS_ConcurrentArena* arena) {
+	DS_ConcurrentArenaFreeBlocks(arena, arena->current_block);
+	DS_ConcurrentArenaFreeBlocks(arena, arena->large_blocks);
+	DS_DebugFillGarbage(arena, sizeof(DS_ConcurrentArena));
+}
+
+DS_API void DS_ConcurrentArenaReset(DS_ConcurrentArena* arena) {
+	DS_ProfEnter();
+	DS_ConcurrentArenaBlock* current = arena->current_block;
+	if (current) {
+		DS_ConcurrentArenaFreeBlocks(arena, current->next);
+		current->next = NULL;
+		current->used = 0;
+	}
+	DS_ConcurrentArenaFreeBlocks(arena, arena->large_blocks);
+	arena->large_blocks = NULL;
+	DS_ProfExit();
+}
+
+DS_API char* DS_ConcurrentArenaPush(DS_ConcurrentArena* arena, size_t size) {
+	return DS_ConcurrentArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+}
+
+DS_API char* DS_ConcurrentArenaPushZero(DS_ConcurrentArena* arena, size_t size) {
+	char* ptr = DS_ConcurrentArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+DS_API char* DS_ConcurrentArenaPushAligned(DS_ConcurrentArena* arena, size_t size, size_t alignment) {
+	DS_ProfEnter();
+	DS_ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	// Block cursors always stay a multiple of DS_DEFAULT_ARENA_PUSH_ALIGNMENT, so only larger alignments need padding.
+	// Padding is reserved up front, because the final address isn't known until the fetch-add returns.
+	size_t reserve = DS_AlignUpPow2(size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+	if (alignment > DS_DEFAULT_ARENA_PUSH_ALIGNMENT) reserve += alignment - DS_DEFAULT_ARENA_PUSH_ALIGNMENT;
+
+	char* result = NULL;
+	if (reserve > arena->block_size / 4) {
+		// Large pushes get a dedicated block, so that they don't waste the rest of the current block.
+		size_t new_block_size = DS_CONCURRENT_ARENA_HEADER_SIZE + reserve;
+		DS_ConcurrentArenaBlock* block = (DS_ConcurrentArenaBlock*)DS_MemAllocAligned(arena->allocator, new_block_size, DS_ARENA_BLOCK_ALIGNMENT);
+		block->size_including_header = new_block_size;
+		block->used = reserve;
+		DS_AtomicAdd64(&arena->total_mem_reserved, new_block_size);
+		for (;;) {
+			block->next = (DS_ConcurrentArenaBlock*)DS_AtomicLoadPtr((void* volatile*)&arena->large_blocks);
+			if (DS_AtomicCompareExchangePtr((void* volatile*)&arena->large_blocks, block->next, block)) break;
+		}
+		result = (char*)block + DS_CONCURRENT_ARENA_HEADER_SIZE;
+	}
+	else {
+		for (;;) {
+			DS_ConcurrentArenaBlock* block = (DS_ConcurrentArenaBlock*)DS_AtomicLoadPtr((void* volatile*)&arena->current_block);
+			if (block) {
+				uint64_t offset = DS_AtomicAdd64(&block->used, reserve);
+				if (offset + reserve <= block->size_including_header - DS_CONCURRENT_ARENA_HEADER_SIZE) {
+					result = (char*)block + DS_CONCURRENT_ARENA_HEADER_SIZE + offset;
+					break;
+				}
+			}
+
+			// The block is full (or missing). Try to install a new block with our allocation already carved out of it.
+			// If another thread beats us to it, give ours back and retry on theirs.
+			DS_ConcurrentArenaBlock* new_block = (DS_ConcurrentArenaBlock*)DS_MemAllocAligned(arena->allocator, arena->block_size, DS_ARENA_BLOCK_ALIGNMENT);
+			new_block->next = block;
+			new_block->size_including_header = arena->block_size;
+			new_block->used = reserve;
+			if (DS_AtomicCompareExchangePtr((void* volatile*)&arena->current_block, block, new_block)) {
+				DS_AtomicAdd64(&arena->total_mem_reserved, arena->block_size);
+				result = (char*)new_block + DS_CONCURRENT_ARENA_HEADER_SIZE;
+				break;
+			}
+			DS_MemFree(arena->allocator, new_block);
+		}
+	}
+
+	result = (char*)DS_AlignUpPow2((uintptr_t)result, alignment);
+	DS_ProfExit();
+	return result;
+}
+
+static void* DS_PoolAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	DS_Pool* pool = (DS_Pool*)allocator;
+	if (size == 0) {
+		if (ptr) DS_PoolFree(pool, ptr);
+		return NULL;
+	}
+	// The allocation doesn't fit in a pool element! A pool can't back growing containers, see DS_Pool.
+	DS_ASSERT(size <= pool->elem_size && align <= pool->elem_alignment);
+	return ptr ? ptr : DS_PoolAlloc(pool);
+}
+
+#define DS_POOL_SLAB_HEADER_SIZE(POOL) DS_AlignUpPow2(sizeof(DS_PoolSlab), (POOL)->elem_alignment)
+
+DS_API void DS_PoolInit(DS_Pool* pool, size_t elem_size, size_t elem_alignment, DS_Allocator* allocator) {
+	DS_ASSERT(elem_alignment != 0 && (elem_alignment & (elem_alignment - 1)) == 0);
+	if (elem_alignment < sizeof(void*)) elem_alignment = sizeof(void*); // free list links are stored in the elements
+	if (elem_size < sizeof(void*)) elem_size = sizeof(void*);
+
+	memset(pool, 0, sizeof(*pool));
+	pool->base.ds = allocator->base.ds;
+	pool->base.allocator_proc = DS_PoolAllocatorProc;
+	pool->allocator = allocator;
+	pool->elem_size = DS_AlignUpPow2(elem_size, elem_alignment);
+	pool->elem_alignment = elem_alignment;
+	pool->slab_size = DS_POOL_SLAB_SIZE;
+	if (pool->slab_size < DS_POOL_SLAB_HEADER_SIZE(pool) + pool->elem_size) {
+		pool->slab_size = DS_POOL_SLAB_HEADER_SIZE(pool) + pool->elem_size;
+	}
+}
+
+DS_API void DS_PoolDeinit(DS_Pool* pool) {
+	for (DS_PoolSlab* slab = pool->slabs; slab;) {
+		DS_PoolSlab* next = slab->next;
+		DS_MemFree(pool->allocator, slab);
+		slab = next;
+	}
+	DS_DebugFillGarbage(pool, sizeof(DS_Pool));
+}
+
+DS_API void* DS_PoolAlloc(DS_Pool* pool) {
+	DS_ProfEnter();
+	void* elem = pool->free_list;
+	if (elem) {
+		pool->free_list = *(void**)elem;
+	}
+	else {
+		if (pool->slab_ptr + pool->elem_size > pool->slab_end) {
+			size_t alignment = pool->elem_alignment > DS_DEFAULT_ALLOCATOR_PROC_ALIGNMENT ? pool->elem_alignment : DS_DEFAULT_ALLOCATOR_PROC_ALIGNMENT;
+			DS_PoolSlab* slab = (DS_PoolSlab*)DS_MemAllocAligned(pool->allocator, pool->slab_size, alignment);
+			slab->next = pool->slabs;
+			pool->slabs = slab;
+			pool->slab_ptr = (char*)slab + DS_POOL_SLAB_HEADER_SIZE(pool);
+			pool->slab_end = (char*)slab + pool->slab_size;
+		}
+		elem = pool->slab_ptr;
+		pool->slab_ptr += pool->elem_size;
+	}
+	pool->count++;
+	DS_ProfExit();
+	return elem;
+}
+
+DS_API void DS_PoolFree(DS_Pool* pool, void* elem) {
+	DS_ASSERT(pool->count > 0);
+	*(void**)elem = pool->free_list;
+	pool->free_list = elem;
+	pool->count--;
+}
+
+DS_API void DS_PoolReset(DS_Pool* pool) {
+	DS_ProfEnter();
+	// Rebuild the free list from the slabs. The newest slab is handed out lazily again, the rest go to the free list.
+	pool->free_list = NULL;
+	if (pool->slabs) {
+		for (DS_PoolSlab* slab = pool->slabs->next; slab; slab = slab->next) {
+			char* end = (char*)slab + pool->slab_size - pool->elem_size;
+			for (char* elem = (char*)slab + DS_POOL_SLAB_HEADER_SIZE(pool); elem <= end; elem += pool->elem_size) {
+				*(void**)elem = pool->free_list;
+				pool->free_list = elem;
+			}
+		}
+		pool->slab_ptr = (char*)pool->slabs + DS_POOL_SLAB_HEADER_SIZE(pool);
+	}
+	pool->count = 0;
+	DS_ProfExit();
+}
+
+// Every block starts with a DS_TLSF_HEADER_SIZE byte header followed by the payload. The free list links of a free
+// block are stored at the start of its payload.
+typedef struct DS_TLSFBlock {
+	struct DS_TLSFBlock* prev_phys; // Only valid when DS_TLSF_PREV_FREE is set
+	size_t size; // Payload size | DS_TLSF_FREE | DS_TLSF_PREV_FREE
+	struct DS_TLSFBlock* next_free;
+	struct DS_TLSFBlock* prev_free;
+} DS_TLSFBlock;
+
+#define DS_TLSF_HEADER_SIZE 16
+#define DS_TLSF_MIN_PAYLOAD 16
+#define DS_TLSF_FREE      ((size_t)1)
+#define DS_TLSF_PREV_FREE ((size_t)2)
+#define DS_TLSF_REGION_HEADER_SIZE DS_AlignUpPow2(sizeof(DS_TLSFRegion), DS_TLSF_ALIGNMENT)
+
+static inline int DS_TLSFMostSignificantBit(size_t x) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long i; _BitScanReverse64(&i, x); return (int)i;
+#elif defined(_MSC_VER)
+	unsigned long i; _BitScanReverse(&i, x); return (int)i;
+#else
+	return (int)(sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(x);
+#endif
+}
+
+static inline size_t DS_TLSFBlockSize(DS_TLSFBlock* block) { return block->size & ~(DS_TLSF_FREE | DS_TLSF_PREV_FREE); }
+static inline char* DS_TLSFPayload(DS_TLSFBlock* block) { return (char*)block + DS_TLSF_HEADER_SIZE; }
+static inline DS_TLSFBlock* DS_TLSFBlockFromPayload(void* ptr) { return (DS_TLSFBlock*)((char*)ptr - DS_TLSF_HEADER_SIZE); }
+static inline DS_TLSFBlock* DS_TLSFNextPhys(DS_TLSFBlock* block) { return (DS_TLSFBlock*)(DS_TLSFPayload(block) + DS_TLSFBlockSize(block)); }
+
+static inline void DS_TLSFMapping(size_t size, int* fl, int* sl) {
+	if (size < ((size_t)1 << DS_TLSF_FL_SHIFT)) {
+		*fl = 0;
+		*sl = (int)(size / (((size_t)1 << DS_TLSF_FL_SHIFT) / DS_TLSF_SL_COUNT));
+	}
+	else {
+		int msb = DS_TLSFMostSignificantBit(size);
+		*sl = (int)(size >> (msb - DS_TLSF_SL_LOG2)) ^ DS_TLSF_SL_COUNT;
+		*fl = msb - DS_TLSF_FL_SHIFT + 1;
+	}
+}
+
+static void DS_TLSFInsertFree(DS_TLSF* tlsf, DS_TLSFBlock* block) {
+	int fl, sl;
+	DS_TLSFMapping(DS_TLSFBlockSize(block), &fl, &sl);
+	DS_TLSFBlock* head = tlsf->free_blocks[fl][sl];
+	block->next_free = head;
+	block->prev_free = NULL;
+	if (head) head->prev_free = block;
+	tlsf->free_blocks[fl][sl] = block;
+	tlsf->fl_bitmap |= 1u << fl;
+	tlsf->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void DS_TLSFRemoveFree(DS_TLSF* tlsf, DS_TLSFBlock* block) {
+	int fl, sl;
+	DS_TLSFMapping(DS_TLSFBlockSize(block), &fl, &sl);
+	if (block->prev_free) block->prev_free->next_free = block->next_free;
+	else {
+		tlsf->free_blocks[fl][sl] = block->next_free;
+		if (block->next_free == NULL) {
+			tlsf->sl_bitmap[fl] &= ~(1u << sl);
+			if (tlsf->sl_bitmap[fl] == 0) tlsf->fl_bitmap &= ~(1u << fl);
+		}
+	}
+	if (block->next_free) block->next_free->prev_free = block->prev_free;
+}
+
+// Finds a free block of at least `size` bytes in O(1) by rounding the size up to the next size class.
+static DS_TLSFBlock* DS_TLSFFindFree(DS_TLSF* tlsf, size_t size) {
+	if (size >= ((size_t)1 << DS_TLSF_FL_SHIFT)) {
+		size += ((size_t)1 << (DS_TLSFMostSignificantBit(size) - DS_TLSF_SL_LOG2)) - 1;
+	}
+	if (size >= ((size_t)1 << DS_TLSF_FL_MAX)) return NULL;
+
+	int fl, sl;
+	DS_TLSFMapping(size, &fl, &sl);
+	uint32_t sl_map = tlsf->sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0) {
+		uint32_t fl_map = fl + 1 < 32 ? tlsf->fl_bitmap & (~0u << (fl + 1)) : 0;
+		if (fl_map == 0) return NULL;
+		fl = DS_CountTrailingZeros32(fl_map);
+		sl_map = tlsf->sl_bitmap[fl];
+	}
+	sl = DS_CountTrailingZeros32(sl_map);
+	return tlsf->free_blocks[fl][sl];
+}
+
+// Marks a block free, merges it with its free neighbours and puts it into the free lists.
+static void DS_TLSFReleaseBlock(DS_TLSF* tlsf, DS_TLSFBlock* block) {
+	block->size |= DS_TLSF_FREE;
+
+	DS_TLSFBlock* next = DS_TLSFNextPhys(block);
+	if (next->size & DS_TLSF_FREE) {
+		DS_TLSFRemoveFree(tlsf, next);
+		block->size += DS_TLSF_HEADER_SIZE + DS_TLSFBlockSize(next);
+	}
+	if (block->size & DS_TLSF_PREV_FREE) {
+		DS_TLSFBlock* prev = block->prev_phys;
+		DS_TLSFRemoveFree(tlsf, prev);
+		prev->size += DS_TLSF_HEADER_SIZE + DS_TLSFBlockSize(block);
+		block = prev;
+	}
+
+	next = DS_TLSFNextPhys(block);
+	next->prev_phys = block;
+	next->size |= DS_TLSF_PREV_FREE;
+	DS_TLSFInsertFree(tlsf, block);
 }
 
-static inline bool DS_MapInsertRaw(DS_MapRaw* map, const void* key, DS_OUT void* val,
-	int K_size, int V_size, int elem_size, int key_offset, int val_offset)
-{
-	DS_ProfEnter();
-	void* val_ptr;
-	bool added = DS_MapGetOrAddRaw(map, key, &val_ptr, K_size, V_size, elem_size, key_offset, val_offset);
-	memcpy(val_ptr, val, V_size);
-	DS_ProfExit();
-	return added;
+// Shrinks a used block to `size` bytes, releasing the remainder if it's large enough to be a block of its own.
+static void DS_TLSFTrimUsed(DS_TLSF* tlsf, DS_TLSFBlock* block, size_t size) {
+	size_t block_size = DS_TLSFBlockSize(block);
+	if (block_size >= size + DS_TLSF_HEADER_SIZE + DS_TLSF_MIN_PAYLOAD) {
+		DS_TLSFBlock* remainder = (DS_TLSFBlock*)(DS_TLSFPayload(block) + size);
+		remainder->size = block_size - size - DS_TLSF_HEADER_SIZE; // the previous block (`block`) is used
+		block->size = size | (block->size & DS_TLSF_PREV_FREE);
+		DS_TLSFReleaseBlock(tlsf, remainder);
+	}
 }
 
-static void* DS_ArenaAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
-	char* data = DS_ArenaPushAligned((DS_Arena*)allocator, (int)size, (int)align); // TODO: use size_t for arenas instead of int
-	if (ptr) memcpy(data, ptr, old_size);
-	return data;
+static void* DS_TLSFAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	DS_TLSF* tlsf = (DS_TLSF*)allocator;
+	if (size == 0) {
+		if (ptr) DS_TLSFFree(tlsf, ptr);
+		return NULL;
+	}
+	void* result = DS_TLSFRealloc(tlsf, ptr, size, align);
+	DS_ASSERT(result != NULL); // Out of memory
+	return result;
 }
 
-DS_API void DS_ArenaInit(DS_Arena* arena, size_t block_size, DS_Allocator* allocator) {
-	memset(arena, 0, sizeof(*arena));
-	arena->base.ds = allocator->base.ds;
-	arena->base.allocator_proc = DS_ArenaAllocatorProc;
-	arena->block_size = block_size;
-	arena->allocator = allocator;
+DS_API void DS_TLSFInit(DS_TLSF* tlsf, size_t region_size, DS_Allocator* allocator, DS_Info* ds) {
+	memset(tlsf, 0, sizeof(*tlsf));
+	tlsf->base.ds = allocator ? allocator->base.ds : ds;
+	tlsf->base.allocator_proc = DS_TLSFAllocatorProc;
+	tlsf->allocator = allocator;
+	tlsf->region_size = region_size;
 }
 
-DS_API void DS_ArenaDeinit(DS_Arena* arena) {
-	for (DS_ArenaBlockHeader* block = arena->first_block; block;) {
-		DS_ArenaBlockHeader* next = block->next;
-		DS_MemFree(arena->allocator, block);
-		block = next;
+DS_API void DS_TLSFDeinit(DS_TLSF* tlsf) {
+	for (DS_TLSFRegion* region = tlsf->regions; region;) {
+		DS_TLSFRegion* next = region->next;
+		if (region->owned) DS_MemFree(tlsf->allocator, region);
+		region = next;
 	}
-	DS_DebugFillGarbage(arena, sizeof(DS_Arena));
+	DS_DebugFillGarbage(tlsf, sizeof(DS_TLSF));
 }
 
-DS_API char* DS_ArenaPush(DS_Arena* arena, size_t size) {
-	return DS_ArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
+static void DS_TLSFAddRegionEx(DS_TLSF* tlsf, void* memory, size_t size, bool owned) {
+	char* start = (char*)DS_AlignUpPow2((uintptr_t)memory, DS_TLSF_ALIGNMENT);
+	size = DS_AlignDownPow2(size - (start - (char*)memory), DS_TLSF_ALIGNMENT);
+	DS_ASSERT(size >= DS_TLSF_REGION_HEADER_SIZE + 2 * DS_TLSF_HEADER_SIZE + DS_TLSF_MIN_PAYLOAD);
+
+	DS_TLSFRegion* region = (DS_TLSFRegion*)start;
+	region->size = size;
+	region->owned = owned;
+	region->next = tlsf->regions;
+	tlsf->regions = region;
+
+	// One big free block, followed by a zero-sized used sentinel block that stops merging at the end of the region
+	DS_TLSFBlock* block = (DS_TLSFBlock*)(start + DS_TLSF_REGION_HEADER_SIZE);
+	block->size = size - DS_TLSF_REGION_HEADER_SIZE - 2 * DS_TLSF_HEADER_SIZE;
+	if (block->size >= ((size_t)1 << DS_TLSF_FL_MAX)) block->size = ((size_t)1 << DS_TLSF_FL_MAX) - DS_TLSF_ALIGNMENT;
+
+	DS_TLSFBlock* sentinel = DS_TLSFNextPhys(block);
+	sentinel->size = 0;
+	DS_TLSFReleaseBlock(tlsf, block);
 }
 
-DS_API char* DS_ArenaPushZero(DS_Arena* arena, size_t size) {
-	char* ptr = DS_ArenaPushAligned(arena, size, DS_DEFAULT_ARENA_PUSH_ALIGNMENT);
-	memset(ptr, 0, size);
-	return ptr;
+DS_API void DS_TLSFAddRegion(DS_TLSF* tlsf, void* memory, size_t size) {
+	DS_TLSFAddRegionEx(tlsf, memory, size, false);
 }
 
-DS_API char* DS_ArenaPushAligned(DS_Arena* arena, size_t size, size_t alignment) {
+DS_API void* DS_TLSFAlloc(DS_TLSF* tlsf, size_t size, size_t alignment) {
 	DS_ProfEnter();
+	DS_ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	size = size < DS_TLSF_MIN_PAYLOAD ? DS_TLSF_MIN_PAYLOAD : DS_AlignUpPow2(size, DS_TLSF_ALIGNMENT);
+
+	// For larger alignments, find a block with room to cut off a free block in front of the aligned payload.
+	size_t front_min = DS_TLSF_HEADER_SIZE + DS_TLSF_MIN_PAYLOAD;
+	size_t search_size = alignment > DS_TLSF_ALIGNMENT ? size + alignment + front_min : size;
+
+	DS_TLSFBlock* block = DS_TLSFFindFree(tlsf, search_size);
+	if (block == NULL && tlsf->allocator) {
+		size_t region_size = DS_TLSF_REGION_HEADER_SIZE + 2 * DS_TLSF_HEADER_SIZE + search_size + DS_TLSF_ALIGNMENT;
+		region_size += region_size / 8; // so that the rounding in DS_TLSFFindFree is covered
+		if (region_size < tlsf->region_size) region_size = tlsf->region_size;
+		void* memory = DS_MemAllocAligned(tlsf->allocator, region_size, DS_TLSF_ALIGNMENT);
+		DS_TLSFAddRegionEx(tlsf, memory, region_size, true);
+		block = DS_TLSFFindFree(tlsf, search_size);
+	}
 
-	bool alignment_is_power_of_2 = ((alignment) & ((alignment)-1)) == 0;
-	DS_ASSERT(alignment != 0 && alignment_is_power_of_2);
-	DS_ASSERT(alignment <= DS_ARENA_BLOCK_ALIGNMENT);
+	char* result = NULL;
+	if (block) {
+		DS_TLSFRemoveFree(tlsf, block);
+		block->size &= ~DS_TLSF_FREE;
+		DS_TLSFNextPhys(block)->size &= ~DS_TLSF_PREV_FREE;
+
+		if (alignment > DS_TLSF_ALIGNMENT) {
+			char* payload = DS_TLSFPayload(block);
+			char* aligned = (char*)DS_AlignUpPow2((uintptr_t)payload, alignment);
+			if (aligned != payload && (size_t)(aligned - payload) < front_min) {
+				aligned = (char*)DS_AlignUpPow2((uintptr_t)(payload + front_min), alignment);
+			}
+			if (aligned != payload) {
+				// Split off the front and free it
+				size_t front_size = aligned - payload - DS_TLSF_HEADER_SIZE;
+				DS_TLSFBlock* aligned_block = DS_TLSFBlockFromPayload(aligned);
+				aligned_block->size = DS_TLSFBlockSize(block) - front_size - DS_TLSF_HEADER_SIZE;
+				block->size = front_size | (block->size & DS_TLSF_PREV_FREE);
+				DS_TLSFReleaseBlock(tlsf, block);
+				block = aligned_block;
+			}
+		}
 
-	DS_ArenaBlockHeader* curr_block = arena->mark.block; // may be NULL
-	void* curr_ptr = arena->mark.ptr;
+		DS_TLSFTrimUsed(tlsf, block, size);
+		tlsf->used_size += DS_TLSFBlockSize(block);
+		result = DS_TLSFPayload(block);
+	}
+	DS_ProfExit();
+	return result;
+}
 
-	char* result_address = (char*)DS_AlignUpPow2((intptr_t)curr_ptr, alignment);
-	intptr_t remaining_space = curr_block ? curr_block->size_including_header - ((intptr_t)result_address - (intptr_t)curr_block) : 0;
+DS_API void DS_TLSFFree(DS_TLSF* tlsf, void* ptr) {
+	DS_ProfEnter();
+	DS_TLSFBlock* block = DS_TLSFBlockFromPayload(ptr);
+	DS_ASSERT(!(block->size & DS_TLSF_FREE)); // Double free!
+	tlsf->used_size -= DS_TLSFBlockSize(block);
+	DS_TLSFReleaseBlock(tlsf, block);
+	DS_ProfExit();
+}
 
-	if ((intptr_t)size > remaining_space) { // We need a new block!
-		intptr_t result_offset = DS_AlignUpPow2(sizeof(DS_ArenaBlockHeader), alignment);
-		intptr_t new_block_size = result_offset + size;
-		if ((intptr_t)arena->block_size > new_block_size) new_block_size = arena->block_size;
+DS_API void* DS_TLSFRealloc(DS_TLSF* tlsf, void* ptr, size_t size, size_t alignment) {
+	if (ptr == NULL) return DS_TLSFAlloc(tlsf, size, alignment);
+	if (size == 0) {
+		DS_TLSFFree(tlsf, ptr);
+		return NULL;
+	}
+	DS_ProfEnter();
 
-		DS_ArenaBlockHeader* new_block = NULL;
-		DS_ArenaBlockHeader* next_block = NULL;
+	void* result = NULL;
+	DS_TLSFBlock* block = DS_TLSFBlockFromPayload(ptr);
+	size_t old_size = DS_TLSFBlockSize(block);
+	size_t new_size = size < DS_TLSF_MIN_PAYLOAD ? DS_TLSF_MIN_PAYLOAD : DS_AlignUpPow2(size, DS_TLSF_ALIGNMENT);
+
+	if (((uintptr_t)ptr & (alignment - 1)) == 0) {
+		// Try to resize in place, absorbing the next block if it's free
+		DS_TLSFBlock* next = DS_TLSFNextPhys(block);
+		if (new_size > old_size && (next->size & DS_TLSF_FREE) && old_size + DS_TLSF_HEADER_SIZE + DS_TLSFBlockSize(next) >= new_size) {
+			DS_TLSFRemoveFree(tlsf, next);
+			block->size += DS_TLSF_HEADER_SIZE + DS_TLSFBlockSize(next);
+			DS_TLSFNextPhys(block)->size &= ~DS_TLSF_PREV_FREE;
+		}
+		if (DS_TLSFBlockSize(block) >= new_size) {
+			DS_TLSFTrimUsed(tlsf, block, new_size);
+			tlsf->used_size += DS_TLSFBlockSize(block) - old_size;
+			result = ptr;
+		}
+	}
 
-		// If there is a block at the end of the list that we have used previously, but aren't using anymore, then try to start using that one.
-		if (curr_block && curr_block->next) {
-			next_block = curr_block->next;
+	if (result == NULL) {
+		result = DS_TLSFAlloc(tlsf, size, alignment);
+		if (result) {
+			memcpy(result, ptr, old_size < size ? old_size : size);
+			DS_TLSFFree(tlsf, ptr);
+		}
+	}
+	DS_ProfExit();
+	return result;
+}
 
-			intptr_t next_block_remaining_space = next_block->size_including_header - result_offset;
-			if ((intptr_t)size <= next_block_remaining_space) {
-				new_block = next_block; // Next block has enough space, let's use it!
+DS_API DS_TLSFStats DS_TLSFGetStats(DS_TLSF* tlsf) {
+	DS_TLSFStats stats = {0};
+	for (DS_TLSFRegion* region = tlsf->regions; region; region = region->next) {
+		stats.total_size += region->size;
+		DS_TLSFBlock* block = (DS_TLSFBlock*)((char*)region + DS_TLSF_REGION_HEADER_SIZE);
+		for (; DS_TLSFBlockSize(block) > 0; block = DS_TLSFNextPhys(block)) {
+			size_t block_size = DS_TLSFBlockSize(block);
+			if (block->size & DS_TLSF_FREE) {
+				stats.free_size += block_size;
+				stats.free_block_count++;
+				if (block_size > stats.largest_free_block) stats.largest_free_block = block_size;
+			}
+			else {
+				stats.used_size += block_size;
+				stats.used_block_count++;
 			}
 		}
+	}
+	stats.fragmentation = stats.free_size ? 1.f - (float)stats.largest_free_block / (float)stats.free_size : 0.f;
+	return stats;
+}
 
-		// Otherwise, insert a new block.
-		if (new_block == NULL) {
-			new_block = (DS_ArenaBlockHeader*)DS_MemAllocAligned(arena->allocator, new_block_size, DS_ARENA_BLOCK_ALIGNMENT);
-			DS_ASSERT(((uintptr_t)new_block & (DS_ARENA_BLOCK_ALIGNMENT - 1)) == 0); // make sure that the alignment is correct
-	
-			new_block->size_including_header = new_block_size;
-			new_block->next = next_block;
-			arena->total_mem_reserved += new_block_size;
+// Every slab starts with a DS_SLAB_HEADER_SIZE byte header. Allocations that go to the parent allocator get a header of
+// their own at a DS_SLAB_SIZE-aligned address, so the header of any block is found by aligning its address down.
+typedef struct DS_SlabHeader {
+	struct DS_SlabHeader* next; // Next slab in DS_SlabAllocator::slabs
+	uint32_t size_class; // DS_SLAB_LARGE for allocations from the parent allocator
+	uint32_t large_offset; // Offset of the block from the header, for large allocations
+	size_t large_size;
+} DS_SlabHeader;
 
-			if (curr_block) curr_block->next = new_block;
-			else arena->first_block = new_block;
+#define DS_SLAB_HEADER_SIZE 64
+#define DS_SLAB_LARGE 0xFFFFFFFF
+
+typedef struct DS_SlabThreadCacheBin {
+	void* head; // Free blocks, linked through their first word
+	uint32_t count;
+} DS_SlabThreadCacheBin;
+
+typedef struct DS_SlabThreadCache {
+	DS_SlabAllocator* owner; // NULL if the slot is unused
+	uint32_t owner_id;
+	DS_SlabThreadCacheBin bins[DS_SLAB_CLASS_COUNT];
+} DS_SlabThreadCache;
+
+static DS_THREAD_LOCAL DS_SlabThreadCache DS_slab_thread_caches[DS_SLAB_THREAD_CACHE_COUNT];
+static volatile uint32_t DS_slab_next_id;
+
+static DS_SlabThreadCache* DS_SlabThreadCaches(void) { return DS_slab_thread_caches; }
+
+static inline DS_SlabHeader* DS_SlabHeaderOf(void* ptr) {
+	return (DS_SlabHeader*)((uintptr_t)ptr & ~((uintptr_t)DS_SLAB_SIZE - 1));
+}
+
+static inline uint32_t DS_SlabSizeClass(size_t size) {
+	if (size <= 128) return size <= 16 ? 0 : (uint32_t)((size - 1) >> 4);
+	int msb = DS_TLSFMostSignificantBit(size - 1);
+	return 8 + (uint32_t)(msb - 7) * 4 + (uint32_t)((size - 1) >> (msb - 2)) - 4;
+}
+
+// Returns the calling thread's cache for this allocator, claiming a free slot if needed. Returns NULL if every slot is
+// taken by other allocators.
+static inline DS_SlabThreadCache* DS_SlabGetThreadCache(DS_SlabAllocator* slab) {
+	DS_SlabThreadCache* caches = slab->get_thread_caches();
+	DS_SlabThreadCache* free_slot = NULL;
+	for (int i = 0; i < DS_SLAB_THREAD_CACHE_COUNT; i++) {
+		DS_SlabThreadCache* cache = &caches[i];
+		if (cache->owner == slab) {
+			if (cache->owner_id == slab->id) return cache;
+			// Left over from an earlier allocator at the same address. Its blocks were freed with its slabs.
+			memset(cache, 0, sizeof(*cache));
 		}
+		if (cache->owner == NULL && free_slot == NULL) free_slot = cache;
+	}
+	if (free_slot) {
+		free_slot->owner = slab;
+		free_slot->owner_id = slab->id;
+	}
+	return free_slot;
+}
 
-		arena->mark.block = new_block;
-		result_address = (char*)new_block + result_offset;
+static void DS_SlabDepotPut(DS_SlabDepot* depot, void* head, void* tail, uint32_t count) {
+	DS_SpinLockEnter(&depot->lock);
+	*(void**)tail = depot->free_list;
+	depot->free_list = head;
+	depot->count += count;
+	DS_SpinLockExit(&depot->lock);
+}
+
+// Takes up to `count` blocks from the depot as a NULL-terminated list. Returns the number of blocks taken.
+static uint32_t DS_SlabDepotTake(DS_SlabDepot* depot, uint32_t count, void** out_list) {
+	DS_SpinLockEnter(&depot->lock);
+	void* head = depot->free_list;
+	void* tail = NULL;
+	uint32_t taken = 0;
+	for (void* block = head; block && taken < count; block = *(void**)block) {
+		tail = block;
+		taken++;
+	}
+	if (tail) {
+		depot->free_list = *(void**)tail;
+		*(void**)tail = NULL;
+	}
+	depot->count -= taken;
+	DS_SpinLockExit(&depot->lock);
+	*out_list = taken ? head : NULL;
+	return taken;
+}
+
+// Allocates a new slab for a size class and links all of its blocks into a list. Returns the number of blocks.
+static uint32_t DS_SlabCarve(DS_SlabAllocator* slab, uint32_t size_class, void** out_head, void** out_tail) {
+	DS_SlabHeader* header = (DS_SlabHeader*)DS_MemAllocAligned(slab->allocator, DS_SLAB_SIZE, DS_SLAB_SIZE);
+	if (header == NULL) return 0;
+	header->size_class = size_class;
+	header->large_offset = 0;
+	header->large_size = 0;
+
+	DS_SpinLockEnter(&slab->slabs_lock);
+	header->next = slab->slabs;
+	slab->slabs = header;
+	DS_SpinLockExit(&slab->slabs_lock);
+
+	size_t class_size = slab->class_size[size_class];
+	uint32_t count = (uint32_t)((DS_SLAB_SIZE - DS_SLAB_HEADER_SIZE) / class_size);
+	char* first = (char*)header + DS_SLAB_HEADER_SIZE;
+	char* last = first + (count - 1) * class_size;
+	for (char* block = first; block < last; block += class_size) {
+		*(void**)block = block + class_size;
 	}
+	*(void**)last = NULL;
+	*out_head = first;
+	*out_tail = last;
+	return count;
+}
 
-	arena->mark.ptr = result_address + size;
-	return result_address;
+// Called when the thread cache bin is empty, or when there's no thread cache. Refills the bin with a magazine from the
+// depot, or from a new slab if the depot is empty.
+static void* DS_SlabAllocSlow(DS_SlabAllocator* slab, DS_SlabThreadCache* cache, uint32_t size_class) {
+	DS_SlabDepot* depot = &slab->depots[size_class];
+	uint32_t wanted = cache ? slab->magazine_size[size_class] : 1;
+
+	void* list;
+	uint32_t count = DS_SlabDepotTake(depot, wanted, &list);
+	if (count == 0) {
+		void* tail;
+		count = DS_SlabCarve(slab, size_class, &list, &tail);
+		if (count == 0) return NULL;
+		if (count > wanted) {
+			// Keep the first `wanted` blocks and put the rest in the depot
+			void* keep_tail = list;
+			for (uint32_t i = 1; i < wanted; i++) keep_tail = *(void**)keep_tail;
+			DS_SlabDepotPut(depot, *(void**)keep_tail, tail, count - wanted);
+			*(void**)keep_tail = NULL;
+			count = wanted;
+		}
+	}
+
+	if (cache) {
+		DS_SlabThreadCacheBin* bin = &cache->bins[size_class];
+		bin->head = *(void**)list;
+		bin->count = count - 1;
+	}
+	return list;
+}
+
+// Moves the first `count` blocks of a thread cache bin to the depot.
+static void DS_SlabFlushBin(DS_SlabAllocator* slab, DS_SlabThreadCacheBin* bin, uint32_t size_class, uint32_t count) {
+	void* head = bin->head;
+	void* tail = head;
+	for (uint32_t i = 1; i < count; i++) tail = *(void**)tail;
+	bin->head = *(void**)tail;
+	bin->count -= count;
+	DS_SlabDepotPut(&slab->depots[size_class], head, tail, count);
+}
+
+static void* DS_SlabAllocLarge(DS_SlabAllocator* slab, size_t size, size_t alignment) {
+	DS_ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment < DS_SLAB_SIZE);
+
+	size_t offset = alignment > DS_SLAB_HEADER_SIZE ? alignment : DS_SLAB_HEADER_SIZE;
+	DS_SlabHeader* header = (DS_SlabHeader*)DS_MemAllocAligned(slab->allocator, offset + size, DS_SLAB_SIZE);
+	if (header == NULL) return NULL;
+	header->next = NULL;
+	header->size_class = DS_SLAB_LARGE;
+	header->large_offset = (uint32_t)offset;
+	header->large_size = size;
+	return (char*)header + offset;
+}
+
+static void* DS_SlabAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	return DS_SlabRealloc((DS_SlabAllocator*)allocator, ptr, size, align);
+}
+
+DS_API void DS_SlabAllocatorInit(DS_SlabAllocator* slab, DS_Allocator* allocator) {
+	DS_ASSERT(DS_SLAB_SIZE >= DS_SLAB_HEADER_SIZE + DS_SLAB_MAX_SIZE);
+	memset(slab, 0, sizeof(*slab));
+	slab->base.ds = allocator->base.ds;
+	slab->base.allocator_proc = DS_SlabAllocatorProc;
+	slab->allocator = allocator;
+	slab->id = DS_AtomicAdd32(&DS_slab_next_id, 1) + 1;
+	slab->get_thread_caches = DS_SlabThreadCaches;
+
+	for (uint32_t i = 0; i < DS_SLAB_CLASS_COUNT; i++) {
+		uint32_t class_size;
+		if (i < 8) {
+			class_size = (i + 1) * 16;
+		}
+		else {
+			uint32_t step = 1u << ((i - 8) / 4 + 5);
+			class_size = (4 + (i - 8) % 4 + 1) * step;
+		}
+		uint32_t magazine_size = DS_SLAB_MAGAZINE_BYTES / class_size;
+		slab->class_size[i] = class_size;
+		slab->magazine_size[i] = magazine_size < 2 ? 2 : magazine_size > 64 ? 64 : magazine_size;
+	}
+}
+
+DS_API void DS_SlabAllocatorDeinit(DS_SlabAllocator* slab) {
+	DS_ProfEnter();
+	DS_SlabThreadCache* caches = slab->get_thread_caches();
+	for (int i = 0; i < DS_SLAB_THREAD_CACHE_COUNT; i++) {
+		DS_SlabThreadCache* cache = &caches[i];
+		if (cache->owner == slab) memset(cache, 0, sizeof(*cache));
+	}
+	for (DS_SlabHeader* header = slab->slabs; header;) {
+		DS_SlabHeader* next = header->next;
+		DS_MemFree(slab->allocator, header);
+		header = next;
+	}
+	DS_DebugFillGarbage(slab, sizeof(DS_SlabAllocator));
 	DS_ProfExit();
 }
 
-DS_API void DS_ArenaReset(DS_Arena* arena) {
+DS_API void DS_SlabAllocatorThreadFlush(DS_SlabAllocator* slab) {
 	DS_ProfEnter();
-	if (arena->first_block) {
-		// Free all blocks after the first block
-		for (DS_ArenaBlockHeader* block = arena->first_block->next; block;) {
-			DS_ArenaBlockHeader* next = block->next;
-			arena->total_mem_reserved -= block->size_including_header;
-			DS_MemFree(arena->allocator, block);
-			block = next;
+	DS_SlabThreadCache* caches = slab->get_thread_caches();
+	for (int i = 0; i < DS_SLAB_THREAD_CACHE_COUNT; i++) {
+		DS_SlabThreadCache* cache = &caches[i];
+		if (cache->owner == slab && cache->owner_id == slab->id) {
+			for (uint32_t size_class = 0; size_class < DS_SLAB_CLASS_COUNT; size_class++) {
+				DS_SlabThreadCacheBin* bin = &cache->bins[size_class];
+				if (bin->count > 0) DS_SlabFlushBin(slab, bin, size_class, bin->count);
+			}
+			memset(cache, 0, sizeof(*cache));
 		}
-		arena->first_block->next = NULL;
+	}
+	DS_ProfExit();
+}
 
-		// Free the first block too if it's larger than the regular block size
-		if (arena->first_block->size_including_header > arena->block_size) {
-			arena->total_mem_reserved -= arena->first_block->size_including_header;
-			DS_MemFree(arena->allocator, arena->first_block);
-			arena->first_block = NULL;
+DS_API void* DS_SlabAlloc(DS_SlabAllocator* slab, size_t size, size_t alignment) {
+	DS_ProfEnter();
+	void* result;
+	if (size <= DS_SLAB_MAX_SIZE && alignment <= DS_SLAB_ALIGNMENT) {
+		uint32_t size_class = DS_SlabSizeClass(size);
+		DS_SlabThreadCache* cache = DS_SlabGetThreadCache(slab);
+		DS_SlabThreadCacheBin* bin = cache ? &cache->bins[size_class] : NULL;
+		if (bin && bin->head) {
+			result = bin->head;
+			bin->head = *(void**)result;
+			bin->count--;
+		}
+		else {
+			result = DS_SlabAllocSlow(slab, cache, size_class);
 		}
 	}
-	arena->mark.block = arena->first_block;
-	arena->mark.ptr = (char*)arena->first_block + sizeof(DS_ArenaBlockHeader);
+	else {
+		result = DS_SlabAllocLarge(slab, size, alignment);
+	}
 	DS_ProfExit();
+	return result;
 }
 
-DS_API DS_ArenaMark DS_ArenaGetMark(DS_Arena* arena) {
-	return arena->mark;
+DS_API void DS_SlabFree(DS_SlabAllocator* slab, void* ptr) {
+	DS_ProfEnter();
+	DS_SlabHeader* header = DS_SlabHeaderOf(ptr);
+	if (header->size_class == DS_SLAB_LARGE) {
+		DS_MemFree(slab->allocator, header);
+	}
+	else {
+		uint32_t size_class = header->size_class;
+		DS_SlabThreadCache* cache = DS_SlabGetThreadCache(slab);
+		if (cache) {
+			DS_SlabThreadCacheBin* bin = &cache->bins[size_class];
+			*(void**)ptr = bin->head;
+			bin->head = ptr;
+			bin->count++;
+			// Keep one magazine's worth of blocks around, so alternating allocs and frees don't bounce off the depot
+			uint32_t magazine_size = slab->magazine_size[size_class];
+			if (bin->count >= 2 * magazine_size) DS_SlabFlushBin(slab, bin, size_class, magazine_size);
+		}
+		else {
+			DS_SlabDepotPut(&slab->depots[size_class], ptr, ptr, 1);
+		}
+	}
+	DS_ProfExit();
 }
 
-DS_API void DS_ArenaSetMark(DS_Arena* arena, DS_ArenaMark mark) {
+DS_API void* DS_SlabRealloc(DS_SlabAllocator* slab, void* ptr, size_t size, size_t alignment) {
+	if (size == 0) {
+		if (ptr) DS_SlabFree(slab, ptr);
+		return NULL;
+	}
+	if (ptr == NULL) return DS_SlabAlloc(slab, size, alignment);
 	DS_ProfEnter();
-	if (mark.block == NULL) {
-		arena->mark.block = arena->first_block;
-		arena->mark.ptr = (char*)arena->first_block + sizeof(DS_ArenaBlockHeader);
+
+	void* result = NULL;
+	DS_SlabHeader* header = DS_SlabHeaderOf(ptr);
+	bool fits_slab = size <= DS_SLAB_MAX_SIZE && alignment <= DS_SLAB_ALIGNMENT;
+	size_t old_size;
+	if (header->size_class == DS_SLAB_LARGE) {
+		old_size = header->large_size;
+		if (!fits_slab && ((uintptr_t)ptr & (alignment - 1)) == 0) {
+			// Let the parent allocator resize in place if it can. The block stays at the same offset from the header.
+			size_t offset = header->large_offset;
+			header = (DS_SlabHeader*)DS_MemResizeAligned(slab->allocator, header, offset + old_size, offset + size, DS_SLAB_SIZE);
+			if (header) {
+				header->large_size = size;
+				result = (char*)header + offset;
+			}
+			DS_ProfExit();
+			return result;
+		}
 	}
 	else {
-		arena->mark = mark;
+		old_size = slab->class_size[header->size_class];
+		if (fits_slab && DS_SlabSizeClass(size) == header->size_class) {
+			DS_ProfExit();
+			return ptr;
+		}
+	}
+
+	result = DS_SlabAlloc(slab, size, alignment);
+	if (result) {
+		memcpy(result, ptr, old_size < size ? old_size : size);
+		DS_SlabFree(slab, ptr);
 	}
 	DS_ProfExit();
+	return result;
+}
+
+#ifdef DS_ALLOCATOR_TRACKING
+// Every tracked allocation is preceded by a DS_TrackingHeader, placed right before the returned pointer.
+typedef struct DS_TrackingHeader {
+	size_t size;
+	uint32_t tag;    // index into DS_TrackingSnapshot::tags
+	uint32_t offset; // from the start of the parent allocation
+} DS_TrackingHeader;
+
+#define DS_TRACKING_HEADER_SIZE 16
+
+static DS_THREAD_LOCAL const char* DS_tracking_tag;
+
+static inline DS_TrackingHeader* DS_TrackingHeaderOf(void* ptr) { return (DS_TrackingHeader*)((char*)ptr - DS_TRACKING_HEADER_SIZE); }
+
+static int DS_TrackingHistogramBucket(size_t size) {
+	int bucket = 0;
+	for (size_t limit = 16; size > limit && bucket < DS_TRACKING_HISTOGRAM_BUCKETS - 1; limit *= 2) bucket++;
+	return bucket;
+}
+
+// Must be called with the lock held. Tags are few, so a linear scan is fine.
+static uint32_t DS_TrackingFindTag(DS_TrackingAllocator* tracker, const char* name) {
+	DS_TrackingSnapshot* stats = &tracker->stats;
+	if (name == NULL) return 0;
+	for (int i = 1; i < stats->tag_count; i++) {
+		if (stats->tags[i].name == name || strcmp(stats->tags[i].name, name) == 0) return (uint32_t)i;
+	}
+	if (stats->tag_count == DS_TRACKING_MAX_TAGS) return 0;
+
+	DS_TrackingTagStats* tag = &stats->tags[stats->tag_count];
+	memset(tag, 0, sizeof(*tag));
+	tag->name = name;
+	return (uint32_t)stats->tag_count++;
+}
+
+// Must be called with the lock held
+static void DS_TrackingAddLiveBytes(DS_TrackingAllocator* tracker, DS_TrackingTagStats* tag, int64_t bytes) {
+	DS_TrackingSnapshot* stats = &tracker->stats;
+	tag->live_bytes += bytes;
+	if (tag->live_bytes > tag->peak_bytes) tag->peak_bytes = tag->live_bytes;
+	stats->live_bytes += bytes;
+	if (stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+}
+
+static void* DS_TrackingAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	DS_TrackingAllocator* tracker = (DS_TrackingAllocator*)allocator;
+	DS_TrackingHeader* header = ptr ? DS_TrackingHeaderOf(ptr) : NULL;
+
+	if (size == 0) {
+		if (header) {
+			DS_SpinLockEnter(&tracker->lock);
+			DS_TrackingTagStats* tag = &tracker->stats.tags[header->tag];
+			tag->free_count++;
+			DS_TrackingAddLiveBytes(tracker, tag, -(int64_t)header->size);
+			DS_SpinLockExit(&tracker->lock);
+			DS_MemFree(tracker->allocator, (char*)ptr - header->offset);
+		}
+		return NULL;
+	}
+
+	if (align < DS_TRACKING_HEADER_SIZE) align = DS_TRACKING_HEADER_SIZE;
+	size_t offset = align; // the header fits in the padding before the aligned pointer
+
+	if (header && header->offset == offset) {
+		// Resize through the parent allocator, so that it can still resize in place
+		size_t prev_size = header->size;
+		uint32_t tag_index = header->tag;
+		char* base = (char*)DS_MemResizeAligned(tracker->allocator, (char*)ptr - offset, offset + prev_size, offset + size, align);
+		if (base == NULL) return NULL;
+		DS_TrackingHeaderOf(base + offset)->size = size;
+
+		DS_SpinLockEnter(&tracker->lock);
+		DS_TrackingTagStats* tag = &tracker->stats.tags[tag_index];
+		tag->resize_count++;
+		DS_TrackingAddLiveBytes(tracker, tag, (int64_t)size - (int64_t)prev_size);
+		DS_SpinLockExit(&tracker->lock);
+		return base + offset;
+	}
+
+	char* base = (char*)DS_MemAllocAligned(tracker->allocator, offset + size, align);
+	if (base == NULL) return NULL;
+	char* result = base + offset;
+	DS_TrackingHeader* new_header = DS_TrackingHeaderOf(result);
+	new_header->size = size;
+	new_header->offset = (uint32_t)offset;
+
+	DS_SpinLockEnter(&tracker->lock);
+	if (header) {
+		// Resized to a different alignment; the allocation keeps its tag
+		new_header->tag = header->tag;
+		DS_TrackingTagStats* tag = &tracker->stats.tags[header->tag];
+		tag->resize_count++;
+		DS_TrackingAddLiveBytes(tracker, tag, (int64_t)size - (int64_t)header->size);
+	}
+	else {
+		new_header->tag = DS_TrackingFindTag(tracker, DS_tracking_tag);
+		DS_TrackingTagStats* tag = &tracker->stats.tags[new_header->tag];
+		tag->alloc_count++;
+		tag->size_histogram[DS_TrackingHistogramBucket(size)]++;
+		DS_TrackingAddLiveBytes(tracker, tag, (int64_t)size);
+	}
+	DS_SpinLockExit(&tracker->lock);
+
+	if (header) {
+		memcpy(result, ptr, header->size < size ? header->size : size);
+		DS_MemFree(tracker->allocator, (char*)ptr - header->offset);
+	}
+	return result;
+}
+
+DS_API DS_Allocator* DS_TrackingAllocatorInit(DS_TrackingAllocator* tracker, DS_Allocator* allocator) {
+	memset(tracker, 0, sizeof(*tracker));
+	tracker->base.ds = allocator->base.ds;
+	tracker->base.allocator_proc = DS_TrackingAllocatorProc;
+	tracker->allocator = allocator;
+	tracker->stats.tag_count = 1;
+	tracker->stats.tags[0].name = "(untagged)";
+	return (DS_Allocator*)tracker;
+}
+
+DS_API void DS_TrackingAllocatorDeinit(DS_TrackingAllocator* tracker) {
+	DS_DebugFillGarbage(tracker, sizeof(DS_TrackingAllocator));
+}
+
+DS_API const char* DS_TrackingSetTag(const char* tag) {
+	const char* prev = DS_tracking_tag;
+	DS_tracking_tag = tag;
+	return prev;
+}
+
+DS_API void DS_TrackingTakeSnapshot(DS_TrackingAllocator* tracker, DS_TrackingSnapshot* out) {
+	DS_SpinLockEnter(&tracker->lock);
+	DS_TrackingSnapshot* stats = &tracker->stats;
+	out->live_bytes = stats->live_bytes;
+	out->peak_bytes = stats->peak_bytes;
+	out->tag_count = stats->tag_count;
+	memcpy(out->tags, stats->tags, stats->tag_count * sizeof(DS_TrackingTagStats));
+	DS_SpinLockExit(&tracker->lock);
+}
+
+DS_API void DS_TrackingDiff(const DS_TrackingSnapshot* before, const DS_TrackingSnapshot* after, DS_TrackingSnapshot* out) {
+	DS_ASSERT(before->tag_count <= after->tag_count); // The snapshots must be taken in order from the same tracker
+	out->live_bytes = after->live_bytes - before->live_bytes;
+	out->peak_bytes = after->peak_bytes - before->peak_bytes;
+	out->tag_count = after->tag_count;
+	for (int i = 0; i < after->tag_count; i++) {
+		const DS_TrackingTagStats* a = &after->tags[i];
+		DS_TrackingTagStats* d = &out->tags[i];
+		*d = *a;
+		if (i < before->tag_count) {
+			const DS_TrackingTagStats* b = &before->tags[i];
+			d->live_bytes -= b->live_bytes;
+			d->peak_bytes -= b->peak_bytes;
+			d->alloc_count -= b->alloc_count;
+			d->resize_count -= b->resize_count;
+			d->free_count -= b->free_count;
+			for (int j = 0; j < DS_TRACKING_HISTOGRAM_BUCKETS; j++) d->size_histogram[j] -= b->size_histogram[j];
+		}
+	}
+}
+
+DS_API char* DS_TrackingDump(const DS_TrackingSnapshot* snapshot, DS_Arena* out, bool json) {
+	// Sort the tags by live bytes, largest first
+	int order[DS_TRACKING_MAX_TAGS];
+	for (int i = 0; i < snapshot->tag_count; i++) {
+		int j = i;
+		for (; j > 0 && snapshot->tags[order[j - 1]].live_bytes < snapshot->tags[i].live_bytes; j--) order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	DS_StatsWriter writer = {out};
+	DS_StatsWriter* w = &writer;
+	DS_StatsAppend(w, "");
+
+	if (json) {
+		DS_StatsAppend(w, "{\"live_bytes\": %lld, \"peak_bytes\": %lld, \"tags\": [", (long long)snapshot->live_bytes, (long long)snapshot->peak_bytes);
+		for (int i = 0; i < snapshot->tag_count; i++) {
+			const DS_TrackingTagStats* tag = &snapshot->tags[order[i]];
+			DS_StatsAppend(w, "%s{\"name\": \"", i > 0 ? ", " : "");
+			for (const char* c = tag->name; *c; c++) {
+				DS_StatsAppend(w, *c == '\\' || *c == '"' ? "\\%c" : "%c", *c);
+			}
+			DS_StatsAppend(w, "\", \"live_bytes\": %lld, \"peak_bytes\": %lld, \"alloc_count\": %lld, \"resize_count\": %lld, \"free_count\": %lld, \"size_histogram\": [",
+				(long long)tag->live_bytes, (long long)tag->peak_bytes, (long long)tag->alloc_count, (long long)tag->resize_count, (long long)tag->free_count);
+			for (int j = 0; j < DS_TRACKING_HISTOGRAM_BUCKETS; j++) {
+				DS_StatsAppend(w, "%s%lld", j > 0 ? ", " : "", (long long)tag->size_histogram[j]);
+			}
+			DS_StatsAppend(w, "]}");
+		}
+		DS_StatsAppend(w, "]}\n");
+	}
+	else {
+		DS_StatsAppend(w, "live: %lld bytes, peak %lld bytes\n", (long long)snapshot->live_bytes, (long long)snapshot->peak_bytes);
+		for (int i = 0; i < snapshot->tag_count; i++) {
+			const DS_TrackingTagStats* tag = &snapshot->tags[order[i]];
+			DS_StatsAppend(w, "  %-20s live %12lld bytes, peak %12lld bytes, %lld allocs, %lld resizes, %lld frees\n", tag->name,
+				(long long)tag->live_bytes, (long long)tag->peak_bytes, (long long)tag->alloc_count, (long long)tag->resize_count, (long long)tag->free_count);
+			DS_StatsAppend(w, "  %-20s sizes:", "");
+			for (int j = 0; j < DS_TRACKING_HISTOGRAM_BUCKETS; j++) {
+				if (tag->size_histogram[j] == 0) continue;
+				if (j < DS_TRACKING_HISTOGRAM_BUCKETS - 1) DS_StatsAppend(w, " <=%llu: %lld", 16ull << j, (long long)tag->size_histogram[j]);
+				else DS_StatsAppend(w, " >%llu: %lld", 16ull << (j - 1), (long long)tag->size_histogram[j]);
+			}
+			DS_StatsAppend(w, "\n");
+		}
+	}
+
+	return writer.data;
+}
+#endif
+
+#if !defined(DS_NO_MALLOC) && !defined(_WIN32)
+// POSIX has no aligned realloc, so every allocation is preceded by a DS_HeapHeader that records where the underlying
+// block starts. Allocations of at least DS_HEAP_MMAP_THRESHOLD bytes get a memory mapping of their own, so that resizing
+// them with mremap moves the pages rather than copying the bytes. mremap is only used where the system headers declare
+// it, e.g. glibc with _GNU_SOURCE (which g++ defines by default); elsewhere large resizes copy.
+
+#if !defined(DS_NO_VIRTUAL_MEMORY)
+#define DS_HEAP_USE_MMAP
+#endif
+
+#ifndef DS_HEAP_MMAP_THRESHOLD
+#define DS_HEAP_MMAP_THRESHOLD DS_KIB(256)
+#endif
+
+#define DS_HEAP_HEADER_SIZE 16
+#define DS_HEAP_MALLOC_ALIGNMENT (2 * sizeof(void*)) // Alignment that malloc guarantees
+#define DS_HEAP_PAGE_SIZE 4096
+
+typedef struct DS_HeapHeader {
+	size_t size;
+	uint32_t offset; // from the start of the malloc block or memory mapping
+	uint32_t mapped; // allocated with mmap rather than malloc
+} DS_HeapHeader;
+
+static inline DS_HeapHeader* DS_HeapHeaderOf(void* ptr) { return (DS_HeapHeader*)((char*)ptr - DS_HEAP_HEADER_SIZE); }
+
+static void DS_HeapRelease(void* ptr) {
+	DS_HeapHeader* header = DS_HeapHeaderOf(ptr);
+	char* base = (char*)ptr - header->offset;
+#ifdef DS_HEAP_USE_MMAP
+	if (header->mapped) {
+		munmap(base, DS_AlignUpPow2(header->offset + header->size, DS_HEAP_PAGE_SIZE));
+		return;
+	}
+#endif
+	free(base);
+}
+
+static void* DS_HeapAllocatorProc(DS_AllocatorBase* allocator, void* ptr, size_t old_size, size_t size, size_t align) {
+	if (size == 0) {
+		if (ptr) DS_HeapRelease(ptr);
+		return NULL;
+	}
+
+	DS_HeapHeader* header = ptr ? DS_HeapHeaderOf(ptr) : NULL;
+	char* result;
+#ifdef DS_HEAP_USE_MMAP
+	if (size >= DS_HEAP_MMAP_THRESHOLD && align <= DS_HEAP_PAGE_SIZE) {
+		size_t offset = DS_AlignUpPow2(DS_HEAP_HEADER_SIZE, align);
+		size_t map_size = DS_AlignUpPow2(offset + size, DS_HEAP_PAGE_SIZE);
+#ifdef MREMAP_MAYMOVE
+		if (header && header->mapped && header->offset == offset) {
+			size_t old_map_size = DS_AlignUpPow2(offset + header->size, DS_HEAP_PAGE_SIZE);
+			char* base = (char*)mremap((char*)ptr - offset, old_map_size, map_size, MREMAP_MAYMOVE);
+			if (base == (char*)MAP_FAILED) return NULL;
+			DS_HeapHeaderOf(base + offset)->size = size;
+			return base + offset;
+		}
+#endif
+		char* base = (char*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == (char*)MAP_FAILED) return NULL;
+		result = base + offset;
+		DS_HeapHeaderOf(result)->offset = (uint32_t)offset;
+		DS_HeapHeaderOf(result)->mapped = 1;
+	}
+	else
+#endif
+	{
+		size_t extra = DS_HEAP_HEADER_SIZE + (align > DS_HEAP_MALLOC_ALIGNMENT ? align - DS_HEAP_MALLOC_ALIGNMENT : 0);
+		if (header && !header->mapped && header->offset <= extra) {
+			size_t old_offset = header->offset;
+			size_t copy_size = header->size < size ? header->size : size;
+			char* base = (char*)realloc((char*)ptr - old_offset, extra + size);
+			if (base == NULL) return NULL;
+			result = (char*)DS_AlignUpPow2((uintptr_t)base + DS_HEAP_HEADER_SIZE, align);
+			// realloc may have moved the block to an address with a different alignment
+			if (result != base + old_offset) memmove(result, base + old_offset, copy_size);
+			DS_HeapHeaderOf(result)->size = size;
+			DS_HeapHeaderOf(result)->offset = (uint32_t)(result - base);
+			DS_HeapHeaderOf(result)->mapped = 0;
+			return result;
+		}
+		char* base = (char*)malloc(extra + size);
+		if (base == NULL) return NULL;
+		result = (char*)DS_AlignUpPow2((uintptr_t)base + DS_HEAP_HEADER_SIZE, align);
+		DS_HeapHeaderOf(result)->offset = (uint32_t)(result - base);
+		DS_HeapHeaderOf(result)->mapped = 0;
+	}
+
+	DS_HeapHeaderOf(result)->size = size;
+	if (ptr) {
+		memcpy(result, ptr, header->size < size ? header->size : size);
+		DS_HeapRelease(ptr);
+	}
+	return result;
 }
+#endif
 
 #ifndef DS_NO_MALLOC
 static void DS_InitBasicMemConfig(DS_BasicMemConfig* mem) {
@@ -1350,3 +5643,11 @@ static void DS_DeinitBasicMemConfig(DS_BasicMemConfig* mem) {
 	DS_ArenaDeinit(&mem->temp_arena);
 }
 #endif
+
+#ifdef DS_ARENA_STATS
+// Call-site capturing wrappers for arena instrumentation. These are defined last so that they don't affect the
+// definitions above; parenthesizing the function name calls the function directly.
+#define DS_ArenaPush(ARENA, SIZE) (DS_ArenaStatsSetSite_(__FILE__, __LINE__), (DS_ArenaPush)((ARENA), (SIZE)))
+#define DS_ArenaPushZero(ARENA, SIZE) (DS_ArenaStatsSetSite_(__FILE__, __LINE__), (DS_ArenaPushZero)((ARENA), (SIZE)))
+#define DS_ArenaPushAligned(ARENA, SIZE, ALIGNMENT) (DS_ArenaStatsSetSite_(__FILE__, __LINE__), (DS_ArenaPushAligned)((ARENA), (SIZE), (ALIGNMENT)))
+#endif
@@ -1227,7 +1227,10 @@ UI_API UI_Box* UI_GetOrAddBox(UI_Key key, bool assert_newly_added) {
 	
 	UI_Box* box = DS_New(UI_Box, UI_TEMP);
 	void* box_voidptr = box; // this is annoying...
-	bool newly_added = DS_MapInsert(&UI_STATE.data_from_key, key, box_voidptr);
+
+	// Both maps use DS_MapHashInt, so the key only needs to be hashed once.
+	uint32_t key_hash = DS_MapHash(&UI_STATE.data_from_key, key);
+	bool newly_added = DS_MapInsertWithHash(&UI_STATE.data_from_key, key, key_hash, box_voidptr);
 	if (assert_newly_added) {
 		UI_ASSERT(newly_added); // If this fails, then a box with the same key has already been added during this frame!
 	}
@@ -1235,7 +1238,7 @@ UI_API UI_Box* UI_GetOrAddBox(UI_Key key, bool assert_newly_added) {
 	box->key = key;
 	
 	void* prev_frame_box = NULL;
-	DS_MapFind(&UI_STATE.prev_frame_data_from_key, key, &prev_frame_box);
+	DS_MapFindWithHash(&UI_STATE.prev_frame_data_from_key, key, key_hash, &prev_frame_box);
 	box->prev_frame = (UI_Box*)prev_frame_box;
 
 	UI_ProfExit();
@@ -1369,6 +1372,7 @@ UI_API void UI_BeginFrame(const UI_Inputs* inputs, UI_Font default_font, UI_Font
 
 	UI_STATE.prev_frame_data_from_key = UI_STATE.data_from_key;
 	DS_MapInit(&UI_STATE.data_from_key, UI_TEMP);
+	DS_MapSetHashFn(&UI_STATE.data_from_key, DS_MapHashInt); // UI keys are already hashes
 	
 	UI_STATE.mouse_clicking_down_box = UI_STATE.mouse_clicking_down_box_new;
 	UI_STATE.mouse_clicking_down_box_new = UI_INVALID_KEY;
@@ -1412,6 +1416,12 @@ UI_API void UI_Init(DS_Allocator* allocator) {
 	DS_ArenaInit(&UI_STATE._prev_frame_arena, DS_KIB(4), allocator);
 	DS_ArenaInit(&UI_STATE._frame_arena, DS_KIB(4), allocator);
 	
+	// Keep the frame arenas' memory around between frames, so that a steady-state frame doesn't hit the heap
+	DS_ArenaSetRetention(&UI_STATE._prev_frame_arena, 0, 64);
+	DS_ArenaSetRetention(&UI_STATE._frame_arena, 0, 64);
+	DS_ArenaSetMaxBlockSize(&UI_STATE._prev_frame_arena, DS_MIB(1));
+	DS_ArenaSetMaxBlockSize(&UI_STATE._frame_arena, DS_MIB(1));
+	
 	DS_ArrInit(&UI_STATE.box_stack, allocator);
 	DS_ArrPush(&UI_STATE.box_stack, NULL);
 